@@ -9,8 +9,6 @@ fi
 
 LIBS="
 	-L/usr/local/lib
-	-licuuc
-	-lcxxrt
 "
 
 BUILD_FLAGS="
@@ -22,6 +20,7 @@ BUILD_FLAGS="
 	-std=c99
 	-isystem/usr/local/include
 	-Iinc
+	$CFLAGS
 "
 
 mkdir -p bin
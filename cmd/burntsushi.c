@@ -5,10 +5,10 @@
 #include "toml2.h"
 
 static void
-emit_escaped(const char *str)
+emit_escaped(const char *str, size_t len)
 {
 	fprintf(stdout, "\"");
-	for (size_t i = 0; i < strlen(str); i += 1) {
+	for (size_t i = 0; i < len; i += 1) {
 		char c = str[i];
 
 		if ('"' == c) {
@@ -50,7 +50,7 @@ emit_doc(toml2_t *doc)
 			}
 
 			toml2_t *subdoc = toml2_index(doc, i);
-			emit_escaped(toml2_name(subdoc));
+			emit_escaped(toml2_name(subdoc), toml2_name_len(subdoc));
 			fprintf(stdout, ":");
 			emit_doc(subdoc);
 		}
@@ -97,7 +97,7 @@ emit_doc(toml2_t *doc)
 	}
 	else if (TOML2_STRING == toml2_type(doc)) {
 		fprintf(stdout, "{\"type\":\"string\",\"value\":");
-		emit_escaped(toml2_string(doc));
+		emit_escaped(toml2_string(doc), toml2_string_len(doc));
 		fprintf(stdout, "}");
 	}
 	else if (TOML2_BOOL == toml2_type(doc)) {
@@ -129,19 +129,11 @@ emit_doc(toml2_t *doc)
 int
 main(int argc, char *argv[])
 {
-	// This is a bit gross, but whatever.
-	char data[2048];
-	bzero(data, sizeof(data));
-
-	fread(data, 1, sizeof(data) - 1, stdin);
-	if (!feof(stdin)) {
-		return -1;
-	}
-
 	toml2_t doc;
 	toml2_init(&doc);
 
-	int ret = toml2_parse(&doc, data, strlen(data));
+	// If stdin is a file the document can point straight into its mapping.
+	int ret = toml2_parse_fd(&doc, STDIN_FILENO, TOML2_ZERO_COPY);
 	if (0 != ret) {
 		fprintf(stderr, "Error %d\n", ret);
 		return ret;
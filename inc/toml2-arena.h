@@ -0,0 +1,38 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+
+typedef struct toml2_arena_block_t toml2_arena_block_t;
+
+// toml2_arena_t is a bump allocator: allocations are carved off the end of
+// the current block and are never freed individually, only all at once via
+// toml2_arena_free. Blocks double in size as the arena fills, so even a
+// large document is a handful of them. A zeroed toml2_arena_t is empty and
+// ready to use.
+typedef struct {
+	// block is the block being allocated from, which links back to the
+	// ones before it.
+	toml2_arena_block_t *block;
+
+	// next, left are the free space remaining at the end of block.
+	char *next;
+	size_t left;
+}
+toml2_arena_t;
+
+// toml2_arena_alloc returns size bytes from arena, suitably aligned for any
+// of the library's structures, or NULL if out of memory. The memory is not
+// zeroed.
+void* toml2_arena_alloc(toml2_arena_t *arena, size_t size);
+
+// toml2_arena_alloc_str works like toml2_arena_alloc, but without aligning
+// the result; this is for strings, which would otherwise waste the padding.
+char* toml2_arena_alloc_str(toml2_arena_t *arena, size_t size);
+
+// toml2_arena_alloc_block starts a new block of exactly size bytes and
+// returns all of it, for a caller that knows up front how much it needs and
+// carves the block up itself. Returns NULL if out of memory.
+void* toml2_arena_alloc_block(toml2_arena_t *arena, size_t size);
+
+// toml2_arena_free releases every block held by arena, leaving it empty.
+void toml2_arena_free(toml2_arena_t *arena);
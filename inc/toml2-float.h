@@ -0,0 +1,30 @@
+#pragma once
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The toml2_float_* functions turn the pieces of a decimal number that the
+// lexer has already validated into the nearest double. None of them depend
+// on the current locale.
+
+#define TOML2_POW10_MIN (-348)
+#define TOML2_POW10_MAX 347
+
+extern const uint64_t toml2_pow10_128[][2];
+
+// toml2_float_fast computes mantissa * 10^exp10 (negated if negative) into
+// out, correctly rounded. mantissa must hold every significant digit. It
+// returns false in the rare cases it can't decide (values near a rounding
+// boundary, subnormals, under/overflow), in which case toml2_float_exact
+// must be used instead.
+bool toml2_float_fast(
+	uint64_t mantissa,
+	int64_t exp10,
+	bool negative,
+	double *out
+);
+
+// toml2_float_exact parses the len bytes of a validated TOML float at src
+// into out. It's slow, and may allocate for long inputs, but always gets the
+// right answer. A non-zero return value means memory ran out.
+int toml2_float_exact(const char *src, size_t len, double *out);
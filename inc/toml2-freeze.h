@@ -0,0 +1,30 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include "toml2.h"
+
+typedef struct {
+	// hash is that of the name of children[idx].
+	uint64_t hash;
+	size_t idx;
+}
+toml2_frozen_slot_t;
+
+// toml2_frozen_t is the read-only form toml2_freeze gives a non-empty table.
+// children holds the table's len children contiguously, sorted by name, so
+// that indexing and iteration are just pointer arithmetic. slots[1..len] is
+// a search tree over the children's name hashes in Eytzinger order: the
+// children of slot k are slots 2k and 2k + 1, so a lookup is a loop of
+// integer compares walking down a flat array, with each level's cache line
+// easy to fetch ahead of time. slots[0] is unused. order lists the children
+// in document order (see toml2_index_doc_order), and follows the slots.
+struct toml2_frozen_t {
+	size_t len;
+	toml2_t *children;
+	toml2_t **order;
+	toml2_frozen_slot_t slots[];
+};
+
+// toml2_frozen_find returns the child of f named by the len bytes at name, or
+// NULL if there isn't one.
+toml2_t* toml2_frozen_find(toml2_frozen_t *f, const char *name, size_t len);
@@ -1,7 +1,91 @@
 #pragma once
 #include <sys/types.h>
 #include <sys/tree.h>
+#include <stdbool.h>
+#include "toml2-arena.h"
+#include "toml2-intern.h"
+#include "toml2-lexer.h"
 
 int toml2_cmp(const void*, const void*);
 
 RB_PROTOTYPE(toml2_tree_t, toml2_t, link, toml2_cmp);
+
+// toml2_section_t is a table header, and everything up to the next one.
+typedef struct {
+	// start is the offset of the header's opening '['.
+	size_t start;
+
+	// key is the child of the root the header falls under: the first part
+	// of its name.
+	toml2_t *key;
+}
+toml2_section_t;
+
+// toml2_sections_t lists the sections of a document, in order.
+typedef struct {
+	toml2_section_t *sections;
+	size_t len, cap;
+
+	// root_keys is the number of the root's children defined before the
+	// first header, which come first in its order vector.
+	size_t root_keys;
+}
+toml2_sections_t;
+
+// toml2_root_t is the state only a document root carries, hung off the root
+// table so that it can be cleaned up by toml2_free.
+struct toml2_root_t {
+	// stream is the state of an in-progress toml2_parse_feed.
+	struct toml2_stream_t *stream;
+
+	// arena holds every node and string of a document parsed with
+	// TOML2_ARENA.
+	toml2_arena_t arena;
+
+	// keys holds every name in the document that doesn't point into the
+	// parsed buffer, each stored once however many tables use it. Names a
+	// reparse drops stay in it until toml2_reparse rebuilds it, once
+	// keys_len, its size just after the parse or the last rebuild, has
+	// been outgrown by the length of the document.
+	toml2_intern_t keys;
+	size_t keys_len;
+
+	// map, map_len are the mapping of a file parsed with TOML2_ZERO_COPY,
+	// which the document's strings point into.
+	void *map;
+	size_t map_len;
+
+	// frozen is set once toml2_freeze has moved the document into arena.
+	bool frozen;
+
+	// flags, len are those of the last successful toml2_parse_flags or
+	// toml2_reparse. For documents toml2_reparse can update in place,
+	// sections is their layout; reparse_ok is set while it's up to date.
+	int flags;
+	size_t len;
+	toml2_sections_t sections;
+	bool reparse_ok;
+
+	// err is the error the last parse or reparse failed with, for
+	// toml2_last_error.
+	toml2_err_t err;
+};
+
+// toml2_root returns the toml2_root_t of doc, which must be a document root,
+// allocating it if need be. It returns NULL if out of memory.
+toml2_root_t* toml2_root(toml2_t *doc);
+
+// toml2_parse_hook, if set, is shown each token before the grammar steps on
+// it, and may change it. It is only for tests, to hand the grammar tokens
+// the lexer never makes.
+extern void (*toml2_parse_hook)(toml2_token_t *tok);
+
+// toml2_parse_tokens parses toks, the tokens toml2_lex_all found in the
+// datalen bytes at data, into root as toml2_parse would, for tools that
+// already have them. Each one is expanded as the grammar gets to it.
+int toml2_parse_tokens(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	const toml2_tokens_t *toks
+);
@@ -0,0 +1,57 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include "toml2.h"
+#include "toml2-arena.h"
+
+typedef struct {
+	// hash, len are those of child's name, kept here so that most misses
+	// never have to look at the child itself.
+	uint64_t hash;
+	size_t len;
+	toml2_t *child;
+}
+toml2_hash_slot_t;
+
+// toml2_hash_t indexes the children of a table by name (see
+// TOML2_HASH_TABLES). It's open-addressed with linear probing, kept at most
+// half full, and a single allocation; cap is always a power of two.
+struct toml2_hash_t {
+	size_t len, cap;
+	toml2_hash_slot_t slots[];
+};
+
+// toml2_hash_str returns the hash of the len bytes at str (64-bit FNV-1a).
+uint64_t toml2_hash_str(const char *str, size_t len);
+
+// toml2_hash_size returns the size in bytes of a toml2_hash_t with room for
+// len children, as toml2_hash_init sets it up.
+size_t toml2_hash_size(size_t len);
+
+// toml2_hash_init sets up the toml2_hash_size(len) bytes at h as an empty
+// table with room for len children.
+void toml2_hash_init(toml2_hash_t *h, size_t len);
+
+// toml2_hash_lookup returns the slot holding the child named by the len
+// bytes at name, which hash to hash, or the empty slot it would go in.
+// There must be room for it (see toml2_hash_reserve).
+toml2_hash_slot_t* toml2_hash_lookup(
+	toml2_hash_t *h,
+	const char *name,
+	size_t len,
+	uint64_t hash
+);
+
+// toml2_hash_reserve makes sure *h has room for one more child, replacing
+// it with a larger copy if need be; *h may be NULL to start a new one. The
+// new copy comes from arena if it isn't NULL, otherwise the heap, in which
+// case the old one is freed. Returns non-zero if out of memory.
+int toml2_hash_reserve(toml2_hash_t **h, toml2_arena_t *arena);
+
+// toml2_hash_find returns the child of h named by the len bytes at name, or
+// NULL if there isn't one.
+toml2_t* toml2_hash_find(toml2_hash_t *h, const char *name, size_t len);
+
+// toml2_hash_add adds child, which h must not already hold, to h, which must
+// have room for it.
+void toml2_hash_add(toml2_hash_t *h, toml2_t *child);
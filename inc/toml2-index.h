@@ -0,0 +1,42 @@
+#pragma once
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// toml2_index_t is a structural index of a document: the offsets, in order,
+// of every byte outside of strings and comments that starts or delimits a
+// token. That is each of []{}=,. and newline, the '#' starting each comment
+// and the opening quote of each string. Single-line strings with nothing in
+// them for the lexer to check (no escapes) are also followed by an entry for
+// their closing quote, and flagged as clean.
+//
+// Building the index is a single vectorized pass over the document. The
+// parser doesn't use it: its lexer already scans strings and comments a
+// vector at a time, and jumping over them by the index measured slower. It
+// is only ever a hint; on malformed input it may disagree with the lexer.
+typedef struct {
+	// pos holds len offsets into the document.
+	uint32_t *pos;
+	size_t len, cap;
+
+	// clean has bit i set if pos[i] is the opening quote of a clean string
+	// and pos[i + 1] its closing quote.
+	uint64_t *clean;
+}
+toml2_index_t;
+
+// toml2_index_build fills idx with the structural index of the len bytes at
+// buf, which must be no more than UINT32_MAX. idx needs to be freed via
+// toml2_index_free regardless of success.
+int toml2_index_build(toml2_index_t *idx, const char *buf, size_t len);
+
+// toml2_index_free releases resources allocated via toml2_index_build.
+void toml2_index_free(toml2_index_t *idx);
+
+// toml2_index_clean returns true if entry i of idx is the opening quote of a
+// clean string.
+static inline bool
+toml2_index_clean(const toml2_index_t *idx, size_t i)
+{
+	return 0 != (idx->clean[i / 64] & ((uint64_t) 1 << (i % 64)));
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include "toml2-arena.h"
+
+typedef struct {
+	const char *str;
+	size_t len;
+	uint64_t hash;
+}
+toml2_intern_slot_t;
+
+// toml2_intern_t is a set of strings, each stored once. A document's keys go
+// through one so that a name repeated across many tables, like the keys of
+// every entry in an array of tables, shares a single copy. A zeroed
+// toml2_intern_t is empty and ready to use.
+typedef struct {
+	// slots is an open-addressed hash table of cap entries, len of which
+	// are in use; cap is always a power of two.
+	toml2_intern_slot_t *slots;
+	size_t len, cap;
+
+	// strs holds the strings themselves, each NUL-terminated; strs_len is
+	// their total size, terminators included.
+	toml2_arena_t strs;
+	size_t strs_len;
+}
+toml2_intern_t;
+
+// toml2_intern returns the copy of the len bytes at str held by t, adding
+// one if there isn't one yet. The copy lives until t is freed. Returns NULL
+// if out of memory.
+const char* toml2_intern(toml2_intern_t *t, const char *str, size_t len);
+
+// toml2_intern_find works like toml2_intern, but returns NULL rather than
+// adding the string if t doesn't hold it.
+const char* toml2_intern_find(toml2_intern_t *t, const char *str, size_t len);
+
+// toml2_intern_move copies every string held by t to dst, which must have
+// room for t->strs_len bytes, and repoints t at them. t's own copies stay
+// valid until toml2_intern_free.
+void toml2_intern_move(toml2_intern_t *t, char *dst);
+
+// toml2_intern_free releases every string held by t, leaving it empty.
+void toml2_intern_free(toml2_intern_t *t);
@@ -0,0 +1,34 @@
+#pragma once
+#include <sys/types.h>
+#include "toml2.h"
+
+// The values of toml2_t's lazy (see TOML2_LAZY).
+enum {
+	// TOML2_LAZY_DONE nodes hold their value as usual.
+	TOML2_LAZY_DONE = 0,
+
+	// TOML2_LAZY_RAW nodes still hold their source text in raw: the digits
+	// of a float, or the body of a string with escape codes.
+	TOML2_LAZY_RAW,
+
+	// TOML2_LAZY_BUSY nodes are being decoded by some thread.
+	TOML2_LAZY_BUSY,
+};
+
+// toml2_lazy_decode replaces node's source text with its value, unless some
+// other thread already has; either way, node holds its value once this
+// returns 0. A non-zero return value means memory ran out, and node is left
+// as it was.
+int toml2_lazy_decode(toml2_t *node);
+
+// toml2_lazy makes sure node holds its value, as toml2_lazy_decode, with the
+// common case of there being nothing to do kept inline.
+static inline int
+toml2_lazy(toml2_t *node)
+{
+	if (TOML2_LAZY_DONE == __atomic_load_n(&node->lazy, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+
+	return toml2_lazy_decode(node);
+}
@@ -1,44 +1,53 @@
 #pragma once
 #include <sys/types.h>
-#include <unicode/utypes.h>
-#include <unicode/uchar.h>
-#include <unicode/ustring.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
-// toml2_lex_t encapsulates both the decoded UTF8 buffer and the current
-// lexer state for an in-progress lex. The lexer is currently streaming --
-// rather than lexing the entire document, the next token can be retrieved via
-// toml2_lex_token. The toml2_lex_tokens contain references to the original
-// buffer and provide functionality to extract the underlying data in the
-// format desired (e.g. UTF8).
+// toml2_lex_t encapsulates the current lexer state for an in-progress lex
+// over a UTF8 buffer. The lexer is currently streaming -- rather than lexing
+// the entire document, the next token can be retrieved via toml2_lex_token.
+// The toml2_lex_tokens contain references to the original buffer and provide
+// functionality to extract the underlying data in the format desired (e.g.
+// UTF8).
 //
-// It should be noted that the underlying decoded buffer *will* be modified
-// in-place to remove extraneous characters (e.g., '["foo"]' will be rewritten
-// as '[foo]  '; escape codes will be handled in a similar manner. The lexer
-// will overwrite extra with ' ' and advance the lexer state past the decoded
-// characters (and the decoded tokens will only have the not-extra bits).
+// The lexer works directly on the caller's bytes and never modifies them;
+// the buffer must outlive the lexer and any tokens produced from it. Escape
+// codes are only validated while lexing and are decoded when a token is
+// extracted.
 //
 typedef struct {
-	// buf_start is the beginning of the heap-allocation for the decoded UTF8
-	// string.
-	UChar *buf_start;
+	// buf_start is the beginning of the caller's UTF8 buffer.
+	const char *buf_start;
 
 	// buf is the current position into buf_start that we're lexing.
-	UChar *buf;
+	const char *buf;
 
-	// line, col are the current position within buf_start that we're lexing
-	// at; these are used for diagnostics and errors.
-	size_t line, col;
+	// line_base, col_base are the line and column of buf_start[0], which
+	// are only other than 1 after toml2_lex_rebase. Positions are otherwise
+	// tracked as byte offsets; see toml2_lex_position.
+	size_t line_base, col_base;
 
-	// buf_len is the total number of UChars available in buf_start.
+	// nl holds the offsets of the nl_len newlines in buf_start, for finding
+	// line numbers. It's only built once a position is asked for; nl_ok is
+	// set once it has been.
+	size_t *nl;
+	size_t nl_len;
+	bool nl_ok;
+
+	// buf_len is the total number of bytes available in buf_start.
 	size_t buf_len;
 
-	// buf_left is the total number of UChars remaining in buf.
+	// buf_left is the total number of bytes remaining in buf.
 	size_t buf_left;
 
 	// err contains any error that might be encountered. Stored here rather
 	// then passing around an outvalue since this is easier on the hands.
 	toml2_err_t err;
+
+	// lazy makes the lexer only check floats rather than work out their
+	// values, leaving fval 0 (see TOML2_LAZY and toml2_lex_decode_double).
+	bool lazy;
 }
 toml2_lex_t;
 
@@ -64,29 +73,66 @@ toml2_token_type_t;
 
 typedef struct {
 	toml2_token_type_t type;
-	size_t line, col;
+
+	// start, end are byte offsets into the lexer's buffer. Pass start to
+	// toml2_lex_position for a line/col.
 	size_t start, end;
 
+	// escaped is set for strings whose source span contains escape codes
+	// that need decoding; other tokens can be copied straight out of the
+	// buffer.
+	bool escaped;
+
 	union {
 		int64_t ival;
 		double fval;
-		struct tm time;
+
+		// time holds the broken-down date, with tm_year being the actual
+		// year and tm_gmtoff the same offset as time_offset.
+		struct {
+			struct tm time;
+
+			// time_nsec is the fractional seconds in nanoseconds; digits
+			// past the ninth are truncated.
+			int32_t time_nsec;
+
+			// time_offset is the UTC offset in seconds east of UTC.
+			int32_t time_offset;
+		};
 	};
 }
 toml2_token_t;
 
 // toml2_lex_init initializes a toml2_lex_t with the provided UTF8-encoded data
-// at data with datalen bytes. This step decodes the UTF8 data and will return 
-// non-zero if invalid UTF8 is provided, so the error code must be checked. The
-// error is stored in the toml2_lex_t, which needs to be unconditionally freed
-// as allocations may be made regardless of success.
+// at data with datalen bytes. This step validates the UTF8 data and will
+// return TOML2_INVALID_UTF8 if invalid UTF8 is provided, so the error code
+// must be checked. The error, with its position, is also stored in the
+// toml2_lex_t, which needs to be unconditionally freed regardless of
+// success.
 int toml2_lex_init(toml2_lex_t *lex, const char *data, size_t datalen);
 
+// toml2_lex_rebase points lex at datalen bytes of data that carry on from
+// wherever lex currently is (the first byte of data is the next one to lex).
+// Line and column numbers carry over. Unlike toml2_lex_init, data is assumed
+// to have been validated as UTF-8 already.
+void toml2_lex_rebase(toml2_lex_t *lex, const char *data, size_t datalen);
+
+// toml2_lex_position converts a byte offset into lex's buffer, such as a
+// token's start, into a one-indexed line and column; col counts bytes. The
+// first call indexes the buffer's newlines so that later ones are cheap.
+void toml2_lex_position(
+	toml2_lex_t *lex,
+	size_t offset,
+	size_t *line,
+	size_t *col
+);
+
 // toml2_lex_free releases resources allocated via toml2_lex_t.
 void toml2_lex_free(toml2_lex_t *lex);
 
 // toml2_lex_token parses the next token from lex into tok. A non-zero return
-// value indicates that there was a lex error.
+// value is the toml2_errcode_t of a lex error, which is also stored in lex
+// along with its position.
 int toml2_lex_token(toml2_lex_t *lex, toml2_token_t *tok);
 
 // toml2_token_dbg_utf8 returns a staticly-allocated string containing the UTF8
@@ -95,6 +141,85 @@ int toml2_lex_token(toml2_lex_t *lex, toml2_token_t *tok);
 // is only valid until the next call.
 const char* toml2_token_dbg_utf8(toml2_lex_t *lex, toml2_token_t *tok);
 
-// toml2_token_utf8 works the same way as toml2_token_utf8 but returns a
+// toml2_token_copy writes the NUL-terminated UTF8 value of tok into dst,
+// which must have room for tok->end - tok->start + 1 bytes, and returns its
+// length (excluding the NUL).
+size_t toml2_token_copy(toml2_lex_t *lex, toml2_token_t *tok, char *dst);
+
+// toml2_token_utf8 works the same way as toml2_token_dbg_utf8 but returns a
 // heap-allocated string which the caller must free.
 char* toml2_token_utf8(toml2_lex_t *lex, toml2_token_t *tok);
+
+// toml2_token_utf8_len works like toml2_token_utf8, and also writes the
+// length of the returned string to len (which may be less than strlen would
+// say if the token decodes to a \u0000).
+char* toml2_token_utf8_len(toml2_lex_t *lex, toml2_token_t *tok, size_t *len);
+
+// toml2_token_view returns a pointer to tok's bytes within the lexer's buffer
+// and writes their length to len. These are not NUL-terminated. If tok has
+// escape codes that need decoding, NULL is returned and toml2_token_utf8_len
+// must be used instead.
+const char* toml2_token_view(toml2_lex_t *lex, toml2_token_t *tok, size_t *len);
+
+// toml2_lex_decode_str writes the decoded form of the len bytes at src, the
+// body of a string token that has escape codes, NUL-terminated to dst, which
+// must have room for len + 1 bytes, and returns its length.
+size_t toml2_lex_decode_str(const char *src, size_t len, char *dst);
+
+// toml2_lex_decode_double works out the value of the len bytes at src, which
+// have already been lexed as a float, into out. A non-zero return value
+// means memory ran out.
+int toml2_lex_decode_double(const char *src, size_t len, double *out);
+
+// toml2_tok_t is the compact, fixed-size form of a toml2_token_t stored by
+// toml2_lex_all. Values that don't fit are kept in side tables on the
+// toml2_tokens_t and referenced by index; position is kept only as a byte
+// offset, so documents over 4GiB can't be tokenized this way.
+typedef struct {
+	uint8_t type;
+	bool escaped;
+
+	// start, len are the token's bytes in the lexed buffer.
+	uint32_t start, len;
+
+	// val indexes nums (for TOML2_TOKEN_INT and TOML2_TOKEN_DOUBLE) or dates
+	// (for TOML2_TOKEN_DATE) in the owning toml2_tokens_t.
+	uint32_t val;
+}
+toml2_tok_t;
+
+// toml2_tok_date_t is the compact form of a TOML2_TOKEN_DATE's value.
+typedef struct {
+	int32_t nsec, offset;
+	int16_t year;
+	int8_t mon;
+	uint8_t mday, hour, min, sec;
+}
+toml2_tok_date_t;
+
+typedef struct {
+	size_t len, cap;
+	toml2_tok_t *toks;
+
+	size_t nums_len, nums_cap;
+	union {
+		int64_t ival;
+		double fval;
+	} *nums;
+
+	size_t dates_len, dates_cap;
+	toml2_tok_date_t *dates;
+}
+toml2_tokens_t;
+
+// toml2_lex_all lexes everything left in lex into out, which must have been
+// zeroed, ending with the TOML2_TOKEN_EOF token. A non-zero return value is
+// the toml2_errcode_t of a lex error (stored in lex as with toml2_lex_token);
+// either way out must be freed with toml2_tokens_free.
+int toml2_lex_all(toml2_lex_t *lex, toml2_tokens_t *out);
+
+// toml2_tokens_get expands the idx-th token of toks into tok.
+void toml2_tokens_get(const toml2_tokens_t *toks, size_t idx, toml2_token_t *tok);
+
+// toml2_tokens_free releases the arrays held by toks.
+void toml2_tokens_free(toml2_tokens_t *toks);
@@ -0,0 +1,45 @@
+#pragma once
+#include <sys/types.h>
+#include <stdbool.h>
+
+typedef struct toml2_proj_t toml2_proj_t;
+
+// toml2_proj_t is a set of paths, as given to toml2_parse_paths, stored as
+// a tree with one level per part. A node matches a key by name, a list
+// index if its name is a number, or anything if its name is "*". Nodes
+// that "*" matches too have everything under the "*" node merged into
+// them, so that a lookup only ever has to follow one node. A zeroed
+// toml2_proj_t matches nothing.
+struct toml2_proj_t {
+	char *name;
+	size_t name_len;
+
+	// is_index is set if name is a number, index.
+	bool is_index;
+	size_t index;
+
+	// all is set if a path ends here, selecting everything under it.
+	bool all;
+
+	toml2_proj_t *children;
+	size_t children_len;
+};
+
+// toml2_proj_init fills in root, which must be zeroed, from the paths_len
+// dotted paths at paths. Returns non-zero if out of memory.
+int toml2_proj_init(toml2_proj_t *root, const char *const *paths, size_t paths_len);
+
+// toml2_proj_find returns the child of proj matching the key named by the
+// len bytes at name, or NULL if there isn't one.
+const toml2_proj_t* toml2_proj_find(
+	const toml2_proj_t *proj,
+	const char *name,
+	size_t len
+);
+
+// toml2_proj_find_index returns the child of proj matching list index idx,
+// or NULL if there isn't one.
+const toml2_proj_t* toml2_proj_find_index(const toml2_proj_t *proj, size_t idx);
+
+// toml2_proj_free releases everything under root, leaving it empty.
+void toml2_proj_free(toml2_proj_t *root);
@@ -0,0 +1,47 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+
+// The toml2_scan_* functions are the block-at-a-time kernels used by the
+// lexer to skip over runs of uninteresting bytes, and to validate its input.
+// They use AVX2 when the compiler targets it, SSE2 otherwise on x86, and
+// fall back to plain C everywhere else; results are identical regardless of
+// which is used.
+
+// toml2_scan_blank returns the number of leading ' ', '\t' and '\r' bytes
+// in the len bytes at buf.
+size_t toml2_scan_blank(const char *buf, size_t len);
+
+// toml2_scan_space works like toml2_scan_blank but also skips '\n'.
+size_t toml2_scan_space(const char *buf, size_t len);
+
+// toml2_scan_newline returns the offset of the first '\n' in the len bytes at
+// buf, or len if there isn't one.
+size_t toml2_scan_newline(const char *buf, size_t len);
+
+// toml2_scan_string returns the offset of the first byte in the len bytes at
+// buf that is either q, esc, '\n' or NUL, or len if there isn't one. This is
+// used to jump between the interesting parts of a string body; literal
+// strings pass q for esc since they have no escapes.
+size_t toml2_scan_string(const char *buf, size_t len, char q, char esc);
+
+// toml2_scan_utf8 returns the offset of the first byte in the len bytes at
+// buf that isn't part of a well-formed UTF-8 sequence, or len if the whole
+// buffer is valid. Overlong encodings, surrogates and values past U+10FFFF
+// are rejected, as is a sequence cut off by the end of the buffer.
+size_t toml2_scan_utf8(const char *buf, size_t len);
+
+// toml2_scan_marks_t has a bit per byte of a 64-byte block for each kind of
+// byte that delimits TOML tokens; bit i of a mask is set if byte i is one.
+// punct covers the single-character tokens other than newline.
+typedef struct {
+	uint64_t punct;
+	uint64_t dquote, squote;
+	uint64_t newline, hash;
+	uint64_t backslash, nul;
+}
+toml2_scan_marks_t;
+
+// toml2_scan_marks classifies the 64 bytes at buf into marks. This is the
+// kernel behind the structural index (see toml2-index.h).
+void toml2_scan_marks(const char *buf, toml2_scan_marks_t *marks);
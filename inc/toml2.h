@@ -6,8 +6,13 @@
 
 typedef struct toml2_t toml2_t;
 typedef struct toml2_err_t toml2_err_t;
+typedef struct toml2_root_t toml2_root_t;
+typedef struct toml2_hash_t toml2_hash_t;
+typedef struct toml2_frozen_t toml2_frozen_t;
 typedef enum toml2_type_t toml2_type_t;
 typedef enum toml2_errcode_t toml2_errcode_t;
+typedef enum toml2_flags_t toml2_flags_t;
+typedef enum toml2_event_type_t toml2_event_type_t;
 
 typedef RB_HEAD(toml2_tree_t, toml2_t) toml2_tree_t;
 
@@ -23,6 +28,7 @@ enum toml2_type_t {
 
 enum toml2_errcode_t {
 	TOML2_NO_ERROR             = 0,
+	// TOML2_ICUUC_ERROR is reserved, and not returned by any function.
 	TOML2_ICUUC_ERROR          = 1,
 	TOML2_INTERNAL_ERROR       = 2,
 	TOML2_NO_MEMORY            = 3,
@@ -41,6 +47,69 @@ enum toml2_errcode_t {
 	TOML2_MISPLACED_IDENTIFIER = 16,
 	TOML2_LIST_REASSIGNED      = 17,
 	TOML2_MIXED_LIST           = 18,
+	TOML2_INVALID_UTF8         = 19,
+	TOML2_ERRNO                = 20,
+};
+
+enum toml2_flags_t {
+	// TOML2_ZERO_COPY makes names and string values that have no escape codes
+	// in the source point straight into the parsed buffer rather than being
+	// copied out of it. The caller must keep the buffer alive (and
+	// unmodified) for as long as the document is in use. Such strings are
+	// NOT NUL-terminated; use toml2_name_len/toml2_string_len.
+	TOML2_ZERO_COPY = 1 << 0,
+
+	// TOML2_ARENA allocates all of the document's nodes and strings from a
+	// few large blocks owned by the root, rather than one malloc apiece.
+	// toml2_free then releases just those blocks without walking the tree,
+	// and related nodes end up close together in memory.
+	TOML2_ARENA = 1 << 2,
+
+	// TOML2_EXACT_SIZE implies TOML2_ARENA, and once the parse succeeds
+	// measures the document and moves it into a single block of exactly
+	// the size it needs, with no spare capacity in any list. The memory a
+	// document takes is then the same every time it's loaded, and freeing
+	// it releases a single block. This costs a second pass over the tree.
+	TOML2_EXACT_SIZE = 1 << 3,
+
+	// TOML2_HASH_TABLES gives every table a hash index of its children
+	// alongside the usual tree, making toml2_get (and adding keys while
+	// parsing) a single probe rather than a walk down the tree comparing
+	// names. Iteration is still in sorted order. This is worth it for
+	// documents with wide tables that are looked up in often.
+	TOML2_HASH_TABLES = 1 << 4,
+
+	// TOML2_LAZY implies TOML2_ZERO_COPY, and further leaves floats and
+	// strings with escape codes as their source text, which is still
+	// checked, until toml2_float/toml2_int or toml2_string/toml2_string_len
+	// first asks for their value. Each value is worked out once, and the
+	// accessors may be called on the same document from several threads at
+	// a time. Decoded strings are NUL-terminated. With TOML2_ARENA or
+	// TOML2_EXACT_SIZE, only floats are left undecoded. This is worth it
+	// for big documents of which only a few values are read.
+	TOML2_LAZY = 1 << 5,
+};
+
+enum toml2_event_type_t {
+	// TOML2_EVENT_TABLE, TOML2_EVENT_ARRAY_TABLE are [table] and [[table]]
+	// headers.
+	TOML2_EVENT_TABLE = 1,
+	TOML2_EVENT_ARRAY_TABLE,
+
+	// TOML2_EVENT_KEY starts a key/value pair, at the top level of a table
+	// or in an inline table. The value follows as its own event(s).
+	TOML2_EVENT_KEY,
+
+	// TOML2_EVENT_VALUE is a string, int, float, date or bool.
+	TOML2_EVENT_VALUE,
+
+	// TOML2_EVENT_ARRAY_BEGIN, TOML2_EVENT_ARRAY_END bracket the values of
+	// an array, and TOML2_EVENT_INLINE_TABLE_BEGIN,
+	// TOML2_EVENT_INLINE_TABLE_END the keys and values of an inline table.
+	TOML2_EVENT_ARRAY_BEGIN,
+	TOML2_EVENT_ARRAY_END,
+	TOML2_EVENT_INLINE_TABLE_BEGIN,
+	TOML2_EVENT_INLINE_TABLE_END,
 };
 
 struct toml2_err_t {
@@ -48,21 +117,32 @@ struct toml2_err_t {
 	// encountered.
 	size_t line, col;
 
-	// err contains a TOML2_ERR_* value; for errors that come from other
-	// sources (TOML2_ICUUC_ERROR), the actual error code is stored in code.
+	// err contains a toml2_errcode_t value; for errors that come from other
+	// sources, the actual error code is stored in code.
 	toml2_errcode_t err;
 
-	// code contains the actual error if err is TOML2_ERR_ERRNO or
-	// TOML2_ICUUC_ERROR.
+	// code contains the actual error (an errno value) if err is
+	// TOML2_ERRNO.
 	int code;
 };
 
 struct toml2_t {
 	toml2_type_t type;
 	const char *name;
+	size_t name_len;
 	RB_ENTRY(toml2_t) link;
 	bool declared;
 
+	// name_borrowed, sval_borrowed are set when name/sval aren't owned by
+	// this node and must not be freed: they point into the parsed buffer
+	// (see TOML2_ZERO_COPY), the arena (see TOML2_ARENA) or, for names, the
+	// document's key table.
+	bool name_borrowed, sval_borrowed;
+
+	// lazy is non-zero while a float or string is still its source text,
+	// held in raw (see TOML2_LAZY). It's only accessed atomically.
+	char lazy;
+
 	union {
 		struct {
 			size_t ary_len, ary_cap;
@@ -72,13 +152,45 @@ struct toml2_t {
 		struct {
 			size_t tree_len;
 			toml2_tree_t tree;
+
+			// root is only set on a document root, for state that
+			// belongs to the whole document.
+			toml2_root_t *root;
+
+			// hash indexes the table by name, if it was parsed with
+			// TOML2_HASH_TABLES.
+			toml2_hash_t *hash;
+
+			// frozen replaces tree and hash once a non-empty table
+			// has been through toml2_freeze.
+			toml2_frozen_t *frozen;
+
+			// order holds the children in the order they were added,
+			// with room for order_cap of them. Once the parse is done,
+			// sorted holds them in name order; toml2_index uses it.
+			toml2_t **order;
+			size_t order_cap;
+			toml2_t **sorted;
+		};
+
+		struct {
+			const char *sval;
+			size_t sval_len;
+		};
+
+		struct {
+			const char *raw;
+			size_t raw_len;
 		};
 
-		const char *sval;
 		int64_t ival;
 		double fval;
 		bool bval;
-		struct tm tval;
+
+		struct {
+			struct tm tval;
+			int32_t tval_nsec, tval_offset;
+		};
 	};
 };
 
@@ -97,6 +209,148 @@ void toml2_free(toml2_t *doc);
 // be re-used for subsequent parses.
 int toml2_parse(toml2_t *doc, const char *data, size_t datalen);
 
+// toml2_parse_flags works like toml2_parse, with flags being any combination
+// of toml2_flags_t values.
+int toml2_parse_flags(
+	toml2_t *doc,
+	const char *data,
+	size_t datalen,
+	int flags
+);
+
+// toml2_parse_paths works like toml2_parse_flags, but only builds the parts
+// of the document under the paths_len paths at paths, which are dotted as
+// for toml2_get_path; a "*" part matches any key or list index. Everything
+// else is lexed, so syntax errors are still caught, but no nodes are made
+// for it and its strings aren't copied, nor are keys defined twice within
+// it noticed. Lists on a path keep all of their elements, so that indexes
+// stay the same, but elements no path selects are left empty. For example,
+// "servers.1.port" builds servers.1.port and an empty servers.0, but nothing
+// else under servers. toml2_reparse parses such a document in full.
+int toml2_parse_paths(
+	toml2_t *doc,
+	const char *data,
+	size_t datalen,
+	int flags,
+	const char *const *paths,
+	size_t paths_len
+);
+
+// toml2_parse_feed parses the next datalen bytes of a document that arrives
+// in pieces, such as from a pipe or socket. Chunks may be split anywhere,
+// including in the middle of a token or a UTF-8 sequence; bytes that can't
+// be parsed yet are buffered internally, so data may be reused as soon as
+// this returns. Once all the input has been fed, toml2_parse_finish must be
+// called to parse whatever's left and check that the document is complete.
+// A non-zero return value indicates an error; later calls then return the
+// same error. TOML2_ZERO_COPY is not available when parsing this way.
+int toml2_parse_feed(toml2_t *doc, const char *data, size_t datalen);
+
+// toml2_parse_finish completes a parse started with toml2_parse_feed. doc
+// must still be freed with toml2_free, whether or not this succeeds.
+int toml2_parse_finish(toml2_t *doc);
+
+// toml2_parse_fd parses the whole document in fd. Regular files are mapped
+// into memory and parsed in place rather than being read into a copy; they
+// must not be truncated while this runs. With TOML2_ZERO_COPY or
+// TOML2_LAZY the mapping is kept until toml2_free instead of the caller
+// having to keep a buffer around. Anything else, like a pipe, is read from
+// its current position and parsed as it arrives, ignoring flags. Returns
+// TOML2_ERRNO with errno set if a system call fails.
+int toml2_parse_fd(toml2_t *doc, int fd, int flags);
+
+// toml2_parse_file opens the file at path and parses it as toml2_parse_fd.
+int toml2_parse_file(toml2_t *doc, const char *path, int flags);
+
+// toml2_key_t is a key, or one part of a dotted one. It is not necessarily
+// NUL-terminated.
+typedef struct {
+	const char *name;
+	size_t len;
+}
+toml2_key_t;
+
+// toml2_event_t is one step through a document, as toml2_parse_events
+// reports it. Nothing it points to outlives the callback it's passed to.
+typedef struct {
+	toml2_event_type_t type;
+
+	// path, path_len are the parts of a table header's name.
+	const toml2_key_t *path;
+	size_t path_len;
+
+	// key is the key of TOML2_EVENT_KEY.
+	toml2_key_t key;
+
+	// value is the value of TOML2_EVENT_VALUE, to be read with the usual
+	// accessors. Its strings are not necessarily NUL-terminated.
+	toml2_t *value;
+}
+toml2_event_t;
+
+// toml2_event_fn_t is a toml2_parse_events callback. Returning non-zero
+// stops the parse.
+typedef int (*toml2_event_fn_t)(void *ctx, const toml2_event_t *ev);
+
+// toml2_parse_events parses datalen bytes of TOML-formatted data from data,
+// passing each table header, key, value and array or inline table boundary
+// to fn, with ctx, in document order, without building a document. Memory
+// use depends only on how deeply the document nests, not on its size. Only
+// the syntax is checked, so documents that define a key twice or mix types
+// in an array, which toml2_parse rejects, are reported as they are. Returns
+// non-zero on a parse error, or whatever fn returned if it stopped early.
+int toml2_parse_events(
+	const char *data,
+	size_t datalen,
+	toml2_event_fn_t fn,
+	void *ctx
+);
+
+// toml2_edit_t is one change made to a buffer: the old_len bytes at offset
+// were replaced by new_len bytes.
+typedef struct {
+	size_t offset, old_len, new_len;
+}
+toml2_edit_t;
+
+// toml2_reparse updates doc, parsed from a buffer since changed by the
+// edits_len edits, to match data, the buffer as it is now. Edits must be
+// sorted by offset and not overlap, with offsets into the buffer as it was
+// before any of them. Only the tables under root keys whose table headers
+// were near an edit are parsed again, and nodes elsewhere are left where
+// they are. Edits before the first table header, documents parsed with
+// TOML2_ZERO_COPY (or TOML2_LAZY), TOML2_ARENA, TOML2_EXACT_SIZE or
+// toml2_parse_feed, and frozen documents are instead parsed again from
+// scratch, with the same flags. Returns TOML2_ERRNO with errno set to
+// EINVAL, leaving doc as it was, if the edits don't fit the buffer. After
+// any other error doc must only be freed.
+int toml2_reparse(
+	toml2_t *doc,
+	const char *data,
+	size_t datalen,
+	const toml2_edit_t *edits,
+	size_t edits_len
+);
+
+// toml2_last_error returns the error that the last toml2_parse* or
+// toml2_reparse call on doc failed with, along with where in the input it
+// was found; line and col count from 1, and are 0 if the error wasn't at any
+// particular place (such as a failed system call). err is TOML2_NO_ERROR if
+// the last parse succeeded.
+toml2_err_t toml2_last_error(toml2_t *doc);
+
+// toml2_freeze converts doc, a parsed document root, into a read-only
+// layout built for lookups: every node moves into one block, breadth-first,
+// with each table's children stored contiguously in sorted order and
+// searched through a flat tree of their name hashes. All of the accessors
+// work as before, and toml2_index on a table becomes O(1). Strings are
+// copied into the block too, and anything TOML2_LAZY left undecoded is
+// decoded, so the document no longer refers to the buffer it was parsed
+// from. The document must not be parsed into again. Freezing a document
+// twice does nothing. A non-zero return value indicates an error, in which
+// case doc is unchanged.
+int toml2_freeze(toml2_t *doc);
+
 // toml2_type_name returns a human-readable string for the given type.
 const char* toml2_type_name(toml2_type_t type);
 
@@ -106,9 +360,14 @@ toml2_type_t toml2_type(toml2_t *node);
 // toml2_name returns the UTF8-encoded string for the name of the passed
 // node. NULL will be returned unless the parent node is a TOML2_TABLE.
 // The name is valid until the node is freed with toml2_free; the caller must
-// copy if longer lifetimes are desired.
+// copy if longer lifetimes are desired. With TOML2_ZERO_COPY, the name may
+// not be NUL-terminated.
 const char* toml2_name(toml2_t *node);
 
+// toml2_name_len returns the length in bytes of toml2_name(node), or 0 if
+// it has no name.
+size_t toml2_name_len(toml2_t *node);
+
 // toml2_get returns the toml2_t for the corresponding key of the passed node.
 // If there is no such node or the input node is not a table, NULL is returned.
 // If NULL is passed in, NULL is passed out.
@@ -127,6 +386,7 @@ toml2_t* toml2_get_path(toml2_t *node, const char *path);
 
 // toml2_float returns the underlying double value, or 0 if the value
 // is not TOML2_FLOAT or TOML2_INT. In the latter case, the value is cast.
+// With TOML2_LAZY, 0 is also returned if memory runs out decoding it.
 double toml2_float(toml2_t *node);
 
 // toml2_bool returns the underlying boolean value, or false if the
@@ -134,30 +394,48 @@ double toml2_float(toml2_t *node);
 bool toml2_bool(toml2_t *node);
 
 // toml2_int returns the underlying int value, or 0 if the value is
-// not TOML2_INT or TOML2_FLOAT. In the latter case, the value is cast.
+// not TOML2_INT or TOML2_FLOAT. In the latter case, the value is cast, and
+// with TOML2_LAZY 0 is also returned if memory runs out decoding it.
 int64_t toml2_int(toml2_t *node);
 
 // toml2_string returns the underlying string value, or NULL if the 
 // node is not a TOML2_STRING. The string is UTF8-encoded, and has a lifetime
 // bound to the toml2_t -- callers desiring longer lifetimes must copy the
-// string.
+// string. With TOML2_ZERO_COPY, the string may not be NUL-terminated. With
+// TOML2_LAZY, NULL is also returned if memory runs out decoding it.
 const char* toml2_string(toml2_t *node);
 
+// toml2_string_len returns the length in bytes of toml2_string(node), or 0 if
+// the node is not a TOML2_STRING.
+size_t toml2_string_len(toml2_t *node);
+
 // toml2_date returns the underlying date value as a C struct tm.
 // If the node is note a TOML2_DATE, a zero'd object is returned. The
 // tm_wday/tm_yday/tm_isdst/tm_zone fields are never filled out.
 struct tm toml2_date(toml2_t *node);
 
+// toml2_date_nsec returns the fractional seconds of a TOML2_DATE in
+// nanoseconds (digits past the ninth are truncated), or 0 if the node is not
+// a TOML2_DATE.
+int32_t toml2_date_nsec(toml2_t *node);
+
+// toml2_date_offset returns the UTC offset of a TOML2_DATE in seconds east of
+// UTC (the same value as tm_gmtoff), or 0 if the node is not a TOML2_DATE.
+int32_t toml2_date_offset(toml2_t *node);
+
 // toml2_len returns the number of subelements. Zero is returned if
 // the passed node is NULL, or neither a TOML2_TABLE nor a TOML2_LIST.
 size_t toml2_len(toml2_t *node);
 
 // toml2_index returns the N-th element within the passed TOML2_TABLE
-// or TOML2_LIST. If the passed node is NULL, or the index is out of bounds,
-// NULL is returned. NOTE: For tables this is incredibly inefficient; consider
-// using an iterator instead (the entire table is enumerated).
+// or TOML2_LIST. Tables are ordered by name, as when iterating. If the
+// passed node is NULL, or the index is out of bounds, NULL is returned.
 toml2_t* toml2_index(toml2_t *node, size_t idx);
 
+// toml2_index_doc_order works like toml2_index, but orders tables' elements
+// as they were first defined in the document.
+toml2_t* toml2_index_doc_order(toml2_t *node, size_t idx);
+
 typedef struct {
 	toml2_t *parent;
 	union {
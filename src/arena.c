@@ -0,0 +1,127 @@
+#include "toml2-arena.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <strings.h>
+
+// Allocations are aligned to this, which is enough for anything in a toml2_t.
+#define TOML2_ARENA_ALIGN 16
+
+// The first block is small so that tiny documents stay tiny; after that each
+// block is twice the last, up to TOML2_ARENA_MAX_BLOCK.
+#define TOML2_ARENA_MIN_BLOCK (4 * 1024)
+#define TOML2_ARENA_MAX_BLOCK (4 * 1024 * 1024)
+
+struct toml2_arena_block_t {
+	toml2_arena_block_t *prev;
+	size_t size;
+
+	// data is where allocations start, padded so that it's aligned.
+	union {
+		char data[1];
+		long double align;
+		void *ptr;
+	};
+};
+
+// toml2_arena_push starts a new block of exactly block_size bytes.
+static int
+toml2_arena_push(toml2_arena_t *arena, size_t block_size)
+{
+	size_t header = offsetof(toml2_arena_block_t, data);
+	if (block_size > SIZE_MAX - header) {
+		return 1;
+	}
+
+	toml2_arena_block_t *block = malloc(header + block_size);
+	if (NULL == block) {
+		return 1;
+	}
+
+	block->prev = arena->block;
+	block->size = block_size;
+
+	arena->block = block;
+	arena->next = block->data;
+	arena->left = block_size;
+	return 0;
+}
+
+// toml2_arena_grow starts a new block with room for at least size bytes.
+static int
+toml2_arena_grow(toml2_arena_t *arena, size_t size)
+{
+	size_t block_size = TOML2_ARENA_MIN_BLOCK;
+	if (NULL != arena->block) {
+		block_size = 2 * arena->block->size;
+		if (block_size > TOML2_ARENA_MAX_BLOCK) {
+			block_size = TOML2_ARENA_MAX_BLOCK;
+		}
+	}
+
+	// Anything bigger than a whole block gets a block to itself.
+	if (block_size < size) {
+		block_size = size;
+	}
+
+	return toml2_arena_push(arena, block_size);
+}
+
+void*
+toml2_arena_alloc(toml2_arena_t *arena, size_t size)
+{
+	size_t pad = (TOML2_ARENA_ALIGN - ((uintptr_t) arena->next % TOML2_ARENA_ALIGN))
+		% TOML2_ARENA_ALIGN;
+
+	if (NULL == arena->block || arena->left < size || arena->left - size < pad) {
+		if (0 != toml2_arena_grow(arena, size)) {
+			return NULL;
+		}
+		pad = 0;
+	}
+
+	char *ptr = arena->next + pad;
+	arena->next = ptr + size;
+	arena->left -= pad + size;
+	return ptr;
+}
+
+char*
+toml2_arena_alloc_str(toml2_arena_t *arena, size_t size)
+{
+	if (NULL == arena->block || arena->left < size) {
+		if (0 != toml2_arena_grow(arena, size)) {
+			return NULL;
+		}
+	}
+
+	char *ptr = arena->next;
+	arena->next += size;
+	arena->left -= size;
+	return ptr;
+}
+
+void*
+toml2_arena_alloc_block(toml2_arena_t *arena, size_t size)
+{
+	if (0 != toml2_arena_push(arena, size)) {
+		return NULL;
+	}
+
+	char *ptr = arena->next;
+	arena->next += size;
+	arena->left = 0;
+	return ptr;
+}
+
+void
+toml2_arena_free(toml2_arena_t *arena)
+{
+	toml2_arena_block_t *block = arena->block;
+	while (NULL != block) {
+		toml2_arena_block_t *prev = block->prev;
+		free(block);
+		block = prev;
+	}
+
+	bzero(arena, sizeof(*arena));
+}
@@ -1,5 +1,8 @@
 #include "toml2.h"
 #include "toml2-grammar.h"
+#include "toml2-hash.h"
+#include "toml2-freeze.h"
+#include "toml2-lazy.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,6 +36,15 @@ toml2_name(toml2_t *this)
 	return this->name;
 }
 
+size_t
+toml2_name_len(toml2_t *this)
+{
+	if (NULL == this) {
+		return 0;
+	}
+	return this->name_len;
+}
+
 toml2_t*
 toml2_get(toml2_t *this, const char *name)
 {
@@ -42,8 +54,16 @@ toml2_get(toml2_t *this, const char *name)
 
 	toml2_t proto = {
 		.name = name,
+		.name_len = strlen(name),
 	};
 
+	if (NULL != this->frozen) {
+		return toml2_frozen_find(this->frozen, proto.name, proto.name_len);
+	}
+	if (NULL != this->hash) {
+		return toml2_hash_find(this->hash, proto.name, proto.name_len);
+	}
+
 	return RB_FIND(toml2_tree_t, &this->tree, &proto);
 }
 
@@ -95,7 +115,7 @@ toml2_float(toml2_t *this)
 	if (TOML2_INT == this->type) {
 		return (double) this->ival;
 	}
-	if (TOML2_FLOAT == this->type) {
+	if (TOML2_FLOAT == this->type && 0 == toml2_lazy(this)) {
 		return this->fval;
 	}
 	return 0.;
@@ -119,7 +139,7 @@ toml2_int(toml2_t *this)
 	if (TOML2_INT == this->type) {
 		return this->ival;
 	}
-	if (TOML2_FLOAT == this->type) {
+	if (TOML2_FLOAT == this->type && 0 == toml2_lazy(this)) {
 		return (int64_t) this->fval;
 	}
 	return 0;
@@ -128,12 +148,21 @@ toml2_int(toml2_t *this)
 const char*
 toml2_string(toml2_t *this)
 {
-	if (NULL != this && TOML2_STRING == this->type) {
+	if (NULL != this && TOML2_STRING == this->type && 0 == toml2_lazy(this)) {
 		return this->sval;
 	}
 	return NULL;
 }
 
+size_t
+toml2_string_len(toml2_t *this)
+{
+	if (NULL != this && TOML2_STRING == this->type && 0 == toml2_lazy(this)) {
+		return this->sval_len;
+	}
+	return 0;
+}
+
 struct tm
 toml2_date(toml2_t *this)
 {
@@ -145,6 +174,24 @@ toml2_date(toml2_t *this)
 	return ret;
 }
 
+int32_t
+toml2_date_nsec(toml2_t *this)
+{
+	if (NULL != this && TOML2_DATE == this->type) {
+		return this->tval_nsec;
+	}
+	return 0;
+}
+
+int32_t
+toml2_date_offset(toml2_t *this)
+{
+	if (NULL != this && TOML2_DATE == this->type) {
+		return this->tval_offset;
+	}
+	return 0;
+}
+
 size_t
 toml2_len(toml2_t *this)
 {
@@ -170,6 +217,14 @@ toml2_index(toml2_t *this, size_t idx)
 		return &this->ary[idx];
 	}
 	if (TOML2_TABLE == this->type && idx < this->tree_len) {
+		if (NULL != this->frozen) {
+			return &this->frozen->children[idx];
+		}
+		if (NULL != this->sorted) {
+			return this->sorted[idx];
+		}
+
+		// Only a document whose parse failed has no sorted vector.
 		toml2_t *tmp = RB_MIN(toml2_tree_t, &this->tree);
 
 		for (size_t i = 0; i < idx; i += 1) {
@@ -181,12 +236,29 @@ toml2_index(toml2_t *this, size_t idx)
 	return NULL;
 }
 
+toml2_t*
+toml2_index_doc_order(toml2_t *this, size_t idx)
+{
+	if (NULL == this) {
+		return NULL;
+	}
+	if (TOML2_TABLE == this->type && idx < this->tree_len) {
+		if (NULL != this->frozen) {
+			return this->frozen->order[idx];
+		}
+		return this->order[idx];
+	}
+	return toml2_index(this, idx);
+}
+
 int
 toml2_iter_init(toml2_iter_t *iter, toml2_t *doc)
 {
 	if (TOML2_TABLE == doc->type) {
 		iter->parent = doc;
-		iter->next = RB_MIN(toml2_tree_t, &doc->tree);
+		iter->next = NULL != doc->frozen
+			? doc->frozen->children
+			: RB_MIN(toml2_tree_t, &doc->tree);
 	}
 	else if (TOML2_LIST == doc->type) {
 		iter->parent = doc;
@@ -204,7 +276,16 @@ toml2_iter_next(toml2_iter_t *iter)
 {
 	if (TOML2_TABLE == iter->parent->type) {
 		toml2_t *next = iter->next;
-		if (NULL != next) {
+		toml2_frozen_t *frozen = iter->parent->frozen;
+
+		if (NULL == next) {
+			return NULL;
+		}
+		if (NULL != frozen) {
+			bool last = next == &frozen->children[frozen->len - 1];
+			iter->next = last ? NULL : next + 1;
+		}
+		else {
 			iter->next = RB_NEXT(toml2_tree_t, &iter->parent->tree, next);
 		}
 		return next;
@@ -0,0 +1,120 @@
+#include "toml2.h"
+#include "toml2-grammar.h"
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// toml2_parse_errno records that a system call failed, with errno, for
+// toml2_last_error and returns TOML2_ERRNO.
+static int
+toml2_parse_errno(toml2_t *doc)
+{
+	int saved = errno;
+	toml2_root_t *root = toml2_root(doc);
+	if (NULL != root) {
+		root->err = (toml2_err_t) { .err = TOML2_ERRNO, .code = saved };
+	}
+
+	errno = saved;
+	return TOML2_ERRNO;
+}
+
+// toml2_parse_read parses whatever's left to read from fd through
+// toml2_parse_feed, for files that can't be mapped: pipes, sockets, ttys.
+static int
+toml2_parse_read(toml2_t *doc, int fd)
+{
+	char buf[64 * 1024];
+
+	for (;;) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return toml2_parse_errno(doc);
+		}
+		if (0 == n) {
+			return toml2_parse_finish(doc);
+		}
+
+		int ret = toml2_parse_feed(doc, buf, (size_t) n);
+		if (0 != ret) {
+			return ret;
+		}
+	}
+}
+
+int
+toml2_parse_fd(toml2_t *doc, int fd, int flags)
+{
+	struct stat st;
+	if (0 != fstat(fd, &st)) {
+		return toml2_parse_errno(doc);
+	}
+
+	if (!S_ISREG(st.st_mode)) {
+		return toml2_parse_read(doc, fd);
+	}
+	if (0 == st.st_size) {
+		// mmap refuses empty mappings.
+		return toml2_parse_flags(doc, "", 0, flags);
+	}
+	if ((uintmax_t) st.st_size > SIZE_MAX) {
+		errno = EFBIG;
+		return toml2_parse_errno(doc);
+	}
+
+	// With TOML2_ZERO_COPY (or TOML2_LAZY) the document keeps pointing into
+	// the mapping, so make sure there's somewhere to keep it before parsing.
+	toml2_root_t *root = NULL;
+	if (flags & (TOML2_ZERO_COPY | TOML2_LAZY)) {
+		if (NULL == (root = toml2_root(doc))) {
+			return TOML2_NO_MEMORY;
+		}
+	}
+
+	size_t len = (size_t) st.st_size;
+	void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == map) {
+		// Not every filesystem supports mapping.
+		return toml2_parse_read(doc, fd);
+	}
+
+	// The whole file is read front to back exactly once; let the kernel
+	// read ahead aggressively and drop pages behind.
+	madvise(map, len, MADV_SEQUENTIAL);
+
+	int ret = toml2_parse_flags(doc, map, len, flags);
+
+	if (NULL != root) {
+		root->map = map;
+		root->map_len = len;
+	}
+	else {
+		munmap(map, len);
+	}
+
+	return ret;
+}
+
+int
+toml2_parse_file(toml2_t *doc, const char *path, int flags)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return toml2_parse_errno(doc);
+	}
+
+	int ret = toml2_parse_fd(doc, fd, flags);
+
+	int saved = errno;
+	close(fd);
+	errno = saved;
+
+	return ret;
+}
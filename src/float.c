@@ -0,0 +1,196 @@
+#include "toml2-float.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// toml2_mul64 sets *hi, *lo to the 128-bit product of a and b.
+static inline void
+toml2_mul64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128) a * b;
+	*hi = (uint64_t) (r >> 64);
+	*lo = (uint64_t) r;
+#else
+	uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+	uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi;
+	uint64_t hl = a_hi * b_lo, hh = a_hi * b_hi;
+	uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+
+	*hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	*lo = (mid << 32) | (ll & 0xFFFFFFFF);
+#endif
+}
+
+// toml2_float_clinger handles the common case of a short mantissa and a
+// small exponent, where both are exact doubles and a single IEEE multiply or
+// divide gives the correctly rounded result.
+static bool
+toml2_float_clinger(uint64_t mantissa, int64_t exp10, double *out)
+{
+	static const double pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+
+	if (mantissa > ((uint64_t) 1 << 53) || exp10 < -22 || exp10 > 22) {
+		return false;
+	}
+
+	double val = (double) mantissa;
+	*out = exp10 < 0 ? val / pow10[-exp10] : val * pow10[exp10];
+	return true;
+}
+
+// toml2_float_eisel_lemire is the algorithm from Lemire, "Number Parsing at a
+// Gigabyte per Second": multiply the normalized mantissa by a 128-bit
+// approximation of 10^exp10 and, unless the truncated bits leave the result
+// ambiguous, round the top 54 bits to 53.
+static bool
+toml2_float_eisel_lemire(uint64_t mantissa, int64_t exp10, double *out)
+{
+	if (exp10 < TOML2_POW10_MIN || exp10 > TOML2_POW10_MAX) {
+		return false;
+	}
+
+	const uint64_t *pow10 = toml2_pow10_128[exp10 - TOML2_POW10_MIN];
+	int clz = __builtin_clzll(mantissa);
+	mantissa <<= clz;
+
+	// 217706 / 2^16 approximates log2(10).
+	uint64_t exp2 = (uint64_t) (((217706 * exp10) >> 16) + 64 + 1023 - clz);
+
+	uint64_t x_hi, x_lo;
+	toml2_mul64(mantissa, pow10[1], &x_hi, &x_lo);
+
+	// If the low bits of the product might carry into the bits we keep,
+	// bring in the rest of the power of ten.
+	if (0x1FF == (x_hi & 0x1FF) && x_lo + mantissa < mantissa) {
+		uint64_t y_hi, y_lo;
+		toml2_mul64(mantissa, pow10[0], &y_hi, &y_lo);
+
+		uint64_t merged_hi = x_hi, merged_lo = x_lo + y_hi;
+		if (merged_lo < x_lo) {
+			merged_hi += 1;
+		}
+		if (
+			0x1FF == (merged_hi & 0x1FF) &&
+			0 == merged_lo + 1 &&
+			y_lo + mantissa < mantissa
+		) {
+			return false;
+		}
+
+		x_hi = merged_hi;
+		x_lo = merged_lo;
+	}
+
+	// Shift down to 54 bits.
+	uint64_t msb = x_hi >> 63;
+	uint64_t bits = x_hi >> (msb + 9);
+	exp2 -= 1 ^ msb;
+
+	// Exactly halfway between two doubles; we can't tell which way the
+	// truncated part of the power of ten would tip it.
+	if (0 == x_lo && 0 == (x_hi & 0x1FF) && 1 == (bits & 3)) {
+		return false;
+	}
+
+	// Round to 53 bits.
+	bits += bits & 1;
+	bits >>= 1;
+	if (bits >> 53) {
+		bits >>= 1;
+		exp2 += 1;
+	}
+
+	// Subnormals, zero and infinity are left to the slow path.
+	if (exp2 - 1 >= 0x7FF - 1) {
+		return false;
+	}
+
+	uint64_t raw = exp2 << 52 | (bits & 0x000FFFFFFFFFFFFF);
+	memcpy(out, &raw, sizeof(*out));
+	return true;
+}
+
+bool
+toml2_float_fast(uint64_t mantissa, int64_t exp10, bool negative, double *out)
+{
+	double val = 0;
+
+	if (
+		0 != mantissa &&
+		!toml2_float_clinger(mantissa, exp10, &val) &&
+		!toml2_float_eisel_lemire(mantissa, exp10, &val)
+	) {
+		return false;
+	}
+
+	*out = negative ? -val : val;
+	return true;
+}
+
+int
+toml2_float_exact(const char *src, size_t len, double *out)
+{
+	// strtod is correctly rounded, but its radix character depends on the
+	// locale. Rewriting the input as "<digits>e<exponent>" sidesteps that:
+	// there's no radix character left to misread.
+	char stack[128];
+	char *buf = stack;
+	size_t cap = len + 24;
+
+	if (cap > sizeof(stack)) {
+		if (NULL == (buf = malloc(cap))) {
+			return 1;
+		}
+	}
+
+	size_t pos = 0, out_len = 0;
+	long long exp10 = 0;
+
+	if (pos < len && ('+' == src[pos] || '-' == src[pos])) {
+		buf[out_len++] = src[pos++];
+	}
+
+	bool fraction = false;
+	for (; pos < len && 'e' != src[pos] && 'E' != src[pos]; pos += 1) {
+		if ('.' == src[pos]) {
+			fraction = true;
+		}
+		else if ('_' != src[pos]) {
+			buf[out_len++] = src[pos];
+			exp10 -= fraction ? 1 : 0;
+		}
+	}
+
+	if (pos < len) {
+		long long sign = 1, exp = 0;
+
+		for (pos += 1; pos < len; pos += 1) {
+			char ch = src[pos];
+			if ('-' == ch) {
+				sign = -1;
+			}
+			else if ('0' <= ch && '9' >= ch && exp < 1000000) {
+				// Anything past this is 0 or infinity regardless.
+				exp = exp * 10 + (ch - '0');
+			}
+		}
+
+		exp10 += sign * exp;
+	}
+
+	out_len += snprintf(buf + out_len, cap - out_len, "e%lld", exp10);
+	buf[out_len] = 0;
+
+	*out = strtod(buf, NULL);
+
+	if (buf != stack) {
+		free(buf);
+	}
+	return 0;
+}
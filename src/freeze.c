@@ -0,0 +1,325 @@
+#include "toml2.h"
+#include "toml2-grammar.h"
+#include "toml2-freeze.h"
+#include "toml2-hash.h"
+#include "toml2-lazy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+
+// toml2_freeze_t is the state of toml2_freeze. The block it builds holds
+// every node, breadth-first, followed by the tables' toml2_frozen_t, then
+// the strings.
+typedef struct {
+	// nodes_len, index_len, strs_len are the sizes of the three parts of
+	// the block.
+	size_t nodes_len, index_len, strs_len;
+
+	// nodes, index, strs are where the next of each is copied to.
+	char *nodes, *index, *strs;
+
+	// names holds one copy of each name in the document, which then moves
+	// into the block.
+	toml2_intern_t names;
+
+	// sorted is scratch space for the slots of the widest table, of which
+	// there are widest.
+	toml2_frozen_slot_t *sorted;
+	size_t widest;
+}
+toml2_freeze_t;
+
+toml2_t*
+toml2_frozen_find(toml2_frozen_t *f, const char *name, size_t len)
+{
+	uint64_t hash = toml2_hash_str(name, len);
+
+	// Walk down to a leaf, keeping track of the path in k; the slot being
+	// searched for is the last one where the path turned left.
+	size_t k = 1;
+	while (k <= f->len) {
+		__builtin_prefetch(&f->slots[4 * k]);
+		k = 2 * k + (f->slots[k].hash < hash);
+	}
+	k >>= __builtin_ctzll(~k) + 1;
+
+	if (0 == k || hash != f->slots[k].hash) {
+		return NULL;
+	}
+
+	toml2_t *child = &f->children[f->slots[k].idx];
+	if (len == child->name_len && 0 == memcmp(name, child->name, len)) {
+		return child;
+	}
+
+	// Two names with the same hash. This is rare enough to not bother
+	// with anything more than a scan.
+	for (size_t i = 0; i < f->len; i += 1) {
+		child = &f->children[i];
+		if (len == child->name_len && 0 == memcmp(name, child->name, len)) {
+			return child;
+		}
+	}
+
+	return NULL;
+}
+
+// toml2_frozen_size returns the size of the toml2_frozen_t of a table with
+// len children.
+static size_t
+toml2_frozen_size(size_t len)
+{
+	return sizeof(toml2_frozen_t)
+		+ (len + 1) * sizeof(toml2_frozen_slot_t)
+		+ len * sizeof(toml2_t*);
+}
+
+// toml2_freeze_count adds the space taken by everything doc refers to, but
+// not doc itself, to the sizes in x.
+static int
+toml2_freeze_count(toml2_freeze_t *x, toml2_t *doc)
+{
+	if (NULL != doc->name && NULL == toml2_intern(&x->names, doc->name, doc->name_len)) {
+		return TOML2_NO_MEMORY;
+	}
+	if (0 != toml2_lazy(doc)) {
+		return TOML2_NO_MEMORY;
+	}
+
+	if (TOML2_TABLE == doc->type) {
+		size_t n = doc->tree_len;
+		x->nodes_len += n * sizeof(toml2_t);
+		if (0 != n) {
+			x->index_len += toml2_frozen_size(n);
+		}
+		if (x->widest < n) {
+			x->widest = n;
+		}
+
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &doc->tree) {
+			int ret = toml2_freeze_count(x, child);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+	}
+	else if (TOML2_LIST == doc->type) {
+		x->nodes_len += doc->ary_len * sizeof(toml2_t);
+		for (size_t i = 0; i < doc->ary_len; i += 1) {
+			int ret = toml2_freeze_count(x, &doc->ary[i]);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+	}
+	else if (TOML2_STRING == doc->type) {
+		x->strs_len += doc->sval_len + 1;
+	}
+
+	return 0;
+}
+
+// toml2_freeze_node makes dst a copy of src, other than its children: those
+// are still src's until toml2_freeze_children gets round to dst.
+static void
+toml2_freeze_node(toml2_freeze_t *x, toml2_t *dst, toml2_t *src)
+{
+	*dst = *src;
+	if (NULL != src->name) {
+		dst->name = toml2_intern_find(&x->names, src->name, src->name_len);
+		dst->name_borrowed = true;
+	}
+
+	if (TOML2_STRING == src->type) {
+		char *sval = x->strs;
+		memcpy(sval, src->sval, src->sval_len);
+		sval[src->sval_len] = 0;
+		x->strs += src->sval_len + 1;
+
+		dst->sval = sval;
+		dst->sval_borrowed = true;
+	}
+}
+
+static int
+toml2_freeze_cmp_hash(const void *lhs, const void *rhs)
+{
+	const toml2_frozen_slot_t *l = lhs;
+	const toml2_frozen_slot_t *r = rhs;
+	return (l->hash > r->hash) - (l->hash < r->hash);
+}
+
+// toml2_freeze_eytzinger fills in the subtree of f rooted at slot k from
+// sorted, an in-order traversal of it, starting at *next.
+static void
+toml2_freeze_eytzinger(
+	toml2_frozen_t *f,
+	toml2_frozen_slot_t *sorted,
+	size_t *next,
+	size_t k
+) {
+	if (k > f->len) {
+		return;
+	}
+
+	toml2_freeze_eytzinger(f, sorted, next, 2 * k);
+	f->slots[k] = sorted[*next];
+	*next += 1;
+	toml2_freeze_eytzinger(f, sorted, next, 2 * k + 1);
+}
+
+// toml2_freeze_children copies the children of doc into the block; doc has
+// already been copied by toml2_freeze_node, and still refers to the old
+// ones.
+static void
+toml2_freeze_children(toml2_freeze_t *x, toml2_t *doc)
+{
+	if (TOML2_TABLE == doc->type) {
+		size_t n = doc->tree_len;
+		toml2_tree_t tree = doc->tree;
+
+		RB_INIT(&doc->tree);
+		doc->hash = NULL;
+		doc->frozen = NULL;
+		if (0 == n) {
+			doc->order = NULL;
+			doc->order_cap = 0;
+			doc->sorted = NULL;
+			return;
+		}
+
+		toml2_t *children = (toml2_t*) x->nodes;
+		x->nodes += n * sizeof(toml2_t);
+
+		size_t i = 0;
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &tree) {
+			toml2_freeze_node(x, &children[i], child);
+			x->sorted[i].hash = toml2_hash_str(child->name, child->name_len);
+			x->sorted[i].idx = i;
+			i += 1;
+		}
+
+		toml2_frozen_t *frozen = (toml2_frozen_t*) x->index;
+		x->index += toml2_frozen_size(n);
+
+		frozen->len = n;
+		frozen->children = children;
+		frozen->order = (toml2_t**) &frozen->slots[n + 1];
+		bzero(&frozen->slots[0], sizeof(frozen->slots[0]));
+
+		qsort(x->sorted, n, sizeof(*x->sorted), &toml2_freeze_cmp_hash);
+		size_t next = 0;
+		toml2_freeze_eytzinger(frozen, x->sorted, &next, 1);
+
+		for (i = 0; i < n; i += 1) {
+			toml2_t *old = doc->order[i];
+			frozen->order[i] = toml2_frozen_find(frozen, old->name, old->name_len);
+		}
+
+		doc->frozen = frozen;
+		doc->order = NULL;
+		doc->order_cap = 0;
+		doc->sorted = NULL;
+	}
+	else if (TOML2_LIST == doc->type) {
+		size_t n = doc->ary_len;
+		toml2_t *ary = doc->ary;
+
+		doc->ary = NULL;
+		doc->ary_cap = n;
+		if (0 == n) {
+			return;
+		}
+
+		doc->ary = (toml2_t*) x->nodes;
+		x->nodes += n * sizeof(toml2_t);
+
+		for (size_t i = 0; i < n; i += 1) {
+			toml2_freeze_node(x, &doc->ary[i], &ary[i]);
+		}
+	}
+}
+
+int
+toml2_freeze(toml2_t *doc)
+{
+	int ret = 0;
+	toml2_root_t *root = toml2_root(doc);
+	if (NULL == root) {
+		return TOML2_NO_MEMORY;
+	}
+	if (root->frozen) {
+		return 0;
+	}
+	if (NULL != root->stream) {
+		// Still in the middle of toml2_parse_feed.
+		return TOML2_INTERNAL_ERROR;
+	}
+
+	toml2_freeze_t x = { 0 };
+	toml2_arena_t block = { 0 };
+	if (0 != (ret = toml2_freeze_count(&x, doc))) {
+		goto cleanup;
+	}
+	x.strs_len += x.names.strs_len;
+
+	if (0 != x.widest) {
+		x.sorted = malloc(x.widest * sizeof(*x.sorted));
+		if (NULL == x.sorted) {
+			ret = TOML2_NO_MEMORY;
+			goto cleanup;
+		}
+	}
+
+	x.nodes = toml2_arena_alloc_block(&block, x.nodes_len + x.index_len + x.strs_len);
+	if (NULL == x.nodes) {
+		ret = TOML2_NO_MEMORY;
+		goto cleanup;
+	}
+	x.index = x.nodes + x.nodes_len;
+	x.strs = x.index + x.index_len;
+	toml2_intern_move(&x.names, x.strs);
+	x.strs += x.names.strs_len;
+
+	// The block itself is the queue for the breadth-first walk: each node
+	// is visited after all those before it, and its children go on the
+	// end.
+	toml2_t old = *doc;
+	char *next = x.nodes;
+	toml2_freeze_children(&x, doc);
+	for (; next < x.nodes; next += sizeof(toml2_t)) {
+		toml2_freeze_children(&x, (toml2_t*) next);
+	}
+
+	// Now drop the old nodes and strings, along with anything that was
+	// only needed to build or refer to them.
+	if (NULL != root->arena.block) {
+		toml2_arena_free(&root->arena);
+	}
+	else {
+		old.root = NULL;
+		toml2_free(&old);
+	}
+	toml2_intern_free(&root->keys);
+	free(root->sections.sections);
+	bzero(&root->sections, sizeof(root->sections));
+	root->reparse_ok = false;
+	if (NULL != root->map) {
+		munmap(root->map, root->map_len);
+		root->map = NULL;
+	}
+
+	root->arena = block;
+	root->frozen = true;
+	bzero(&block, sizeof(block));
+
+	cleanup: {
+		toml2_arena_free(&block);
+		toml2_intern_free(&x.names);
+		free(x.sorted);
+		return ret;
+	}
+}
@@ -1,8 +1,16 @@
 #include "toml2.h"
 #include "toml2-lexer.h"
 #include "toml2-grammar.h"
+#include "toml2-scan.h"
+#include "toml2-arena.h"
+#include "toml2-intern.h"
+#include "toml2-hash.h"
+#include "toml2-proj.h"
+#include "toml2-lazy.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -20,7 +28,15 @@ toml2_cmp(const void *lhs, const void *rhs)
 		return l == r ? 0 : (l == NULL ? 1 : -1);
 	}
 
-	return strcmp(l->name, r->name);
+	// Names aren't necessarily NUL-terminated (see TOML2_ZERO_COPY), but
+	// this orders them the same way strcmp would.
+	size_t len = l->name_len < r->name_len ? l->name_len : r->name_len;
+	int cmp = memcmp(l->name, r->name, len);
+	if (0 != cmp) {
+		return cmp;
+	}
+
+	return (l->name_len > r->name_len) - (l->name_len < r->name_len);
 }
 
 void
@@ -30,18 +46,35 @@ toml2_init(toml2_t *doc)
 	RB_INIT(&doc->tree);
 }
 
+static void toml2_root_free(toml2_root_t *root);
+
 void
 toml2_free(toml2_t *doc)
 {
-	free((char*) doc->name);
+	if (!doc->name_borrowed) {
+		free((char*) doc->name);
+	}
 
 	if (TOML2_TABLE == doc->type) {
+		// With TOML2_ARENA, every node and string under the root is in the
+		// arena; dropping it is all there is to do.
+		bool arena = NULL != doc->root && NULL != doc->root->arena.block;
+
+		toml2_root_free(doc->root);
+		if (arena) {
+			RB_INIT(&doc->tree);
+			doc->tree_len = 0;
+			return;
+		}
+
 		while (!RB_EMPTY(&doc->tree)) {
 			toml2_t *child = RB_MIN(toml2_tree_t, &doc->tree);
 			RB_REMOVE(toml2_tree_t, &doc->tree, child);
 			toml2_free(child);
 			free(child);
 		}
+		free(doc->hash);
+		free(doc->order);
 	}
 	else if (TOML2_LIST == doc->type) {
 		for (size_t i = 0; i < doc->ary_len; i += 1) {
@@ -50,7 +83,7 @@ toml2_free(toml2_t *doc)
 		}
 		free(doc->ary);
 	}
-	else if (TOML2_STRING == doc->type) {
+	else if (TOML2_STRING == doc->type && !doc->sval_borrowed) {
 		free((char*) doc->sval);
 	}
 }
@@ -79,20 +112,124 @@ typedef enum {
 }
 toml2_parse_mode_t;
 
+// toml2_frame_t is an entry in the parse stack. With toml2_parse_paths,
+// proj is what the node's children have to match to be built; it's NULL
+// once everything under the node is wanted. A NULL doc is a value outside
+// the paths, which is only checked for syntax.
 typedef struct {
 	toml2_t *doc;
 	toml2_parse_mode_t prev_mode;
+	const toml2_proj_t *proj;
 }
 toml2_frame_t;
 
+// toml2_proj_none matches nothing. Elements of a list that no path selects
+// are kept with it, so that the ones after them keep their indexes, but
+// nothing under them is.
+static const toml2_proj_t toml2_proj_none;
+
 typedef struct {
 	toml2_lex_t *lex;
+	int flags;
+
+	// arena is where the document is allocated from with TOML2_ARENA, or
+	// NULL to use the heap.
+	toml2_arena_t *arena;
+
+	// keys is the document's key table (see toml2_root_t).
+	toml2_intern_t *keys;
+
+	// proj is what the root's children have to match to be built, with
+	// toml2_parse_paths (see toml2_frame_t).
+	const toml2_proj_t *proj;
+
+	// track, if set, gets an entry for each table header as it's parsed
+	// (see toml2_root_t.sections).
+	toml2_sections_t *track;
+
+	// events, events_ctx are set by toml2_parse_events, which hands the
+	// document to them piece by piece instead of building it. path holds
+	// the path_len parts of the name of the table header being read.
+	toml2_event_fn_t events;
+	void *events_ctx;
+	toml2_key_t *path;
+	size_t path_len, path_cap;
+
+	// toks, if set, is where tokens come from instead of the lexer (see
+	// toml2_parse_tokens); toks_at is the next one.
+	const toml2_tokens_t *toks;
+	size_t toks_at;
+
 	size_t stack_len;
 	size_t stack_cap;
 	toml2_frame_t *stack;
 }
 toml2_parse_t;
 
+// toml2_parse_str extracts the string value of tok. With TOML2_ZERO_COPY,
+// escape-free tokens are returned as a view into the input, and with
+// TOML2_ARENA copies come from the arena; both set borrowed. Otherwise the
+// caller owns the returned heap copy.
+static const char*
+toml2_parse_str(
+	toml2_parse_t *p,
+	toml2_token_t *tok,
+	size_t *len,
+	bool *borrowed
+) {
+	if (p->flags & TOML2_ZERO_COPY) {
+		const char *view = toml2_token_view(p->lex, tok, len);
+		if (NULL != view) {
+			*borrowed = true;
+			return view;
+		}
+	}
+
+	if (NULL != p->arena) {
+		char *buf = toml2_arena_alloc_str(p->arena, tok->end - tok->start + 1);
+		if (NULL == buf) {
+			return NULL;
+		}
+
+		*len = toml2_token_copy(p->lex, tok, buf);
+		*borrowed = true;
+		return buf;
+	}
+
+	*borrowed = false;
+	return toml2_token_utf8_len(p->lex, tok, len);
+}
+
+// toml2_frame_reserve_order makes sure the order vector of table has room
+// for one more child.
+static int
+toml2_frame_reserve_order(toml2_parse_t *p, toml2_t *table)
+{
+	if (table->tree_len < table->order_cap) {
+		return 0;
+	}
+
+	size_t new_cap = 2 * table->order_cap + 4;
+	toml2_t **new_order;
+
+	if (NULL != p->arena) {
+		new_order = toml2_arena_alloc(p->arena, new_cap * sizeof(toml2_t*));
+		if (NULL != new_order && 0 != table->tree_len) {
+			memcpy(new_order, table->order, table->tree_len * sizeof(toml2_t*));
+		}
+	}
+	else {
+		new_order = realloc(table->order, new_cap * sizeof(toml2_t*));
+	}
+	if (NULL == new_order) {
+		return TOML2_NO_MEMORY;
+	}
+
+	table->order = new_order;
+	table->order_cap = new_cap;
+	return 0;
+}
+
 static int
 toml2_frame_new_slot(
 	toml2_parse_t *p,
@@ -114,38 +251,147 @@ toml2_frame_new_slot(
 		return TOML2_INTERNAL_ERROR;
 	}
 
-	char *name = toml2_token_utf8(p->lex, tok);
-	toml2_t *doc = toml2_get(top->doc, name);
-	if (NULL != doc) {
-		// Just free the name, it's already set.
-		free(name);
+	// Existing keys can be found without copying the name out of the
+	// buffer, as long as it doesn't need unescaping.
+	toml2_t proto = {0};
+	char *tmp = NULL;
+	proto.name = toml2_token_view(p->lex, tok, &proto.name_len);
+	if (NULL == proto.name) {
+		tmp = toml2_token_utf8_len(p->lex, tok, &proto.name_len);
+		if (NULL == tmp) {
+			return TOML2_NO_MEMORY;
+		}
+		proto.name = tmp;
+	}
+
+	// Keys outside the paths being built are left out.
+	const toml2_proj_t *proj = NULL;
+	if (NULL != top->proj) {
+		proj = toml2_proj_find(top->proj, proto.name, proto.name_len);
+		if (NULL == proj) {
+			free(tmp);
+			out->doc = NULL;
+			out->prev_mode = 0;
+			out->proj = NULL;
+			return 0;
+		}
+		if (proj->all) {
+			proj = NULL;
+		}
+	}
+
+	// With TOML2_HASH_TABLES, one probe both finds an existing key and
+	// claims the slot for a new one.
+	toml2_t *doc;
+	toml2_hash_slot_t *slot = NULL;
+	uint64_t hash = 0;
+	if (p->flags & TOML2_HASH_TABLES) {
+		if (0 != toml2_hash_reserve(&top->doc->hash, p->arena)) {
+			free(tmp);
+			return TOML2_NO_MEMORY;
+		}
+
+		hash = toml2_hash_str(proto.name, proto.name_len);
+		slot = toml2_hash_lookup(top->doc->hash, proto.name, proto.name_len, hash);
+		doc = slot->child;
 	}
 	else {
+		doc = RB_FIND(toml2_tree_t, &top->doc->tree, &proto);
+	}
+
+	if (NULL == doc) {
 		// Otherwise need to allocate a new toml2_t and give it the name.
-		doc = malloc(sizeof(toml2_t));
+		if (0 != toml2_frame_reserve_order(p, top->doc)) {
+			free(tmp);
+			return TOML2_NO_MEMORY;
+		}
+
+		doc = NULL != p->arena
+			? toml2_arena_alloc(p->arena, sizeof(toml2_t))
+			: malloc(sizeof(toml2_t));
 		if (NULL == doc) {
-			free(name);
+			free(tmp);
 			return TOML2_NO_MEMORY;
 		}
 
+		// Names belong to the document's key table, which stores each
+		// one once however many tables use it, unless they can point
+		// straight into the buffer instead.
 		toml2_init(doc);
-		doc->name = name;
+		doc->name_len = proto.name_len;
+		doc->name_borrowed = true;
+		doc->name = NULL == tmp && (p->flags & TOML2_ZERO_COPY)
+			? proto.name
+			: toml2_intern(p->keys, proto.name, proto.name_len);
+		if (NULL == doc->name) {
+			free(tmp);
+			if (NULL == p->arena) {
+				free(doc);
+			}
+			return TOML2_NO_MEMORY;
+		}
+
+		if (NULL != slot) {
+			slot->hash = hash;
+			slot->len = doc->name_len;
+			slot->child = doc;
+			top->doc->hash->len += 1;
+		}
 
 		RB_INSERT(toml2_tree_t, &top->doc->tree, doc);
+		top->doc->order[top->doc->tree_len] = doc;
 		top->doc->tree_len += 1;
 	}
 
+	free(tmp);
 	out->doc = doc;
 	out->prev_mode = 0;
+	out->proj = proj;
 	return 0;
 }
 
-static int
-toml2_frame_push_slot(toml2_frame_t *top, toml2_frame_t *out)
+// toml2_frame_proj_index returns the proj of the element at idx of a list
+// whose own proj is list (see toml2_frame_t).
+static const toml2_proj_t*
+toml2_frame_proj_index(const toml2_proj_t *list, size_t idx)
 {
+	if (NULL == list) {
+		return NULL;
+	}
+
+	const toml2_proj_t *proj = toml2_proj_find_index(list, idx);
+	if (NULL == proj) {
+		return &toml2_proj_none;
+	}
+	return proj->all ? NULL : proj;
+}
+
+static int
+toml2_frame_push_slot(
+	toml2_parse_t *p,
+	toml2_frame_t *top,
+	toml2_frame_t *out
+) {
 	if (top->doc->ary_len == top->doc->ary_cap) {
 		size_t new_cap = top->doc->ary_cap + 3;
-		void *new_data = realloc(top->doc->ary, new_cap * sizeof(toml2_t));
+		void *new_data;
+
+		if (NULL != p->arena) {
+			// Outgrown arrays are left behind in the arena, so grow
+			// geometrically to keep the waste linear.
+			new_cap = 2 * top->doc->ary_cap + 4;
+			new_data = toml2_arena_alloc(p->arena, new_cap * sizeof(toml2_t));
+			if (NULL != new_data && 0 != top->doc->ary_len) {
+				memcpy(
+					new_data,
+					top->doc->ary,
+					top->doc->ary_len * sizeof(toml2_t)
+				);
+			}
+		}
+		else {
+			new_data = realloc(top->doc->ary, new_cap * sizeof(toml2_t));
+		}
 		if (NULL == new_data) {
 			return TOML2_NO_MEMORY;
 		}
@@ -156,6 +402,7 @@ toml2_frame_push_slot(toml2_frame_t *top, toml2_frame_t *out)
 
 	out->doc = &top->doc->ary[top->doc->ary_len];
 	out->prev_mode = 0;
+	out->proj = toml2_frame_proj_index(top->proj, top->doc->ary_len);
 	toml2_init(out->doc);
 
 	top->doc->ary_len += 1;
@@ -163,21 +410,45 @@ toml2_frame_push_slot(toml2_frame_t *top, toml2_frame_t *out)
 }
 
 static int
-toml2_frame_save(toml2_frame_t *top, toml2_lex_t *lex, toml2_token_t *tok)
+toml2_frame_save(toml2_parse_t *p, toml2_frame_t *top, toml2_token_t *tok)
 {
-	if (TOML2_TOKEN_STRING == tok->type) {
-		top->doc->type = TOML2_STRING;
-		top->doc->sval = toml2_token_utf8(lex, tok);
-	}
-	else if (TOML2_TOKEN_IDENTIFIER == tok->type) {
-		char *val = toml2_token_utf8(lex, tok);
+	// With TOML2_LAZY, strings that would need decoding into a copy, and
+	// floats, are kept as their source text for toml2_lazy_decode. Arena
+	// documents aren't walked when freed, so can't own decoded strings.
+	bool lazy = (p->flags & TOML2_LAZY) && (
+		(TOML2_TOKEN_STRING == tok->type && tok->escaped && NULL == p->arena) ||
+		TOML2_TOKEN_DOUBLE == tok->type
+	);
+	if (lazy) {
+		top->doc->type = TOML2_TOKEN_STRING == tok->type
+			? TOML2_STRING
+			: TOML2_FLOAT;
+		top->doc->raw = p->lex->buf_start + tok->start;
+		top->doc->raw_len = tok->end - tok->start;
+		top->doc->sval_borrowed = true;
+		top->doc->lazy = TOML2_LAZY_RAW;
+	}
+	else if (TOML2_TOKEN_STRING == tok->type) {
+		const char *val = toml2_parse_str(
+			p,
+			tok,
+			&top->doc->sval_len,
+			&top->doc->sval_borrowed
+		);
 		if (NULL == val) {
 			return TOML2_NO_MEMORY;
 		}
 
-		bool is_true = !strcmp(val, "true");
-		bool is_false = !strcmp(val, "false");
-		free(val);
+		top->doc->type = TOML2_STRING;
+		top->doc->sval = val;
+	}
+	else if (TOML2_TOKEN_IDENTIFIER == tok->type) {
+		// Identifiers never contain escapes.
+		size_t len;
+		const char *val = toml2_token_view(p->lex, tok, &len);
+
+		bool is_true = 4 == len && !memcmp(val, "true", 4);
+		bool is_false = 5 == len && !memcmp(val, "false", 5);
 
 		if (!is_true && !is_false) {
 			return TOML2_MISPLACED_IDENTIFIER;
@@ -197,6 +468,8 @@ toml2_frame_save(toml2_frame_t *top, toml2_lex_t *lex, toml2_token_t *tok)
 	else if (TOML2_TOKEN_DATE == tok->type) {
 		top->doc->type = TOML2_DATE;
 		top->doc->tval = tok->time;
+		top->doc->tval_nsec = tok->time_nsec;
+		top->doc->tval_offset = tok->time_offset;
 	}
 	else {
 		return TOML2_PARSE_ERROR;
@@ -206,16 +479,74 @@ toml2_frame_save(toml2_frame_t *top, toml2_lex_t *lex, toml2_token_t *tok)
 }
 
 static void
-toml2_parse_init(toml2_parse_t *p, toml2_lex_t *lex)
+toml2_parse_init(toml2_parse_t *p, toml2_lex_t *lex, int flags)
 {
 	bzero(p, sizeof(toml2_parse_t));
 	p->lex = lex;
+	p->flags = flags;
 }
 
 static void
 toml2_parse_free(toml2_parse_t *p)
 {
 	free(p->stack);
+	free(p->path);
+}
+
+// toml2_parse_next fetches the next non-comment token into tok.
+static int
+toml2_parse_next(toml2_parse_t *p, toml2_token_t *tok)
+{
+	int ret;
+
+	do {
+		if (0 != (ret = toml2_lex_token(p->lex, tok))) {
+			return ret;
+		}
+	}
+	while (TOML2_TOKEN_COMMENT == tok->type);
+
+	return 0;
+}
+
+// toml2_parse_next_tok is toml2_parse_next for a parser that takes its
+// tokens from p->toks.
+static int
+toml2_parse_next_tok(toml2_parse_t *p, toml2_token_t *tok)
+{
+	do {
+		if (p->toks_at == p->toks->len) {
+			return TOML2_PARSE_ERROR;
+		}
+
+		toml2_tokens_get(p->toks, p->toks_at, tok);
+		p->toks_at += 1;
+	}
+	while (TOML2_TOKEN_COMMENT == tok->type);
+
+	return 0;
+}
+
+// toml2_parse_locate records err, which stopped a parse at tok (or wherever
+// the lexer is, if tok is NULL), in lex->err along with its position, and
+// returns it. Errors from the lexer are already there as they are.
+static int
+toml2_parse_locate(toml2_lex_t *lex, const toml2_token_t *tok, int err)
+{
+	if (err == (int) lex->err.err) {
+		return err;
+	}
+
+	lex->err = (toml2_err_t) { .err = err };
+	if (TOML2_ERRNO == err) {
+		lex->err.code = errno;
+	}
+	if (NULL != lex->buf_start) {
+		size_t at = NULL != tok ? tok->start : (size_t) (lex->buf - lex->buf_start);
+		toml2_lex_position(lex, at, &lex->err.line, &lex->err.col);
+	}
+
+	return err;
 }
 
 static toml2_frame_t*
@@ -247,6 +578,38 @@ toml2_parse_push(toml2_parse_t *p, toml2_frame_t frame)
 	return 0;
 }
 
+// toml2_sections_add appends a section starting at start to t.
+static int
+toml2_sections_add(toml2_sections_t *t, size_t start, toml2_t *key)
+{
+	if (t->len == t->cap) {
+		size_t new_cap = 2 * t->cap + 4;
+		void *new_data = realloc(t->sections, new_cap * sizeof(toml2_section_t));
+		if (NULL == new_data) {
+			return TOML2_NO_MEMORY;
+		}
+
+		t->sections = new_data;
+		t->cap = new_cap;
+	}
+
+	t->sections[t->len].start = start;
+	t->sections[t->len].key = key;
+	t->len += 1;
+	return 0;
+}
+
+// toml2_parse_track adds the table header starting at tok to p->track.
+static int
+toml2_parse_track(toml2_parse_t *p, toml2_token_t *tok)
+{
+	if (0 == p->track->len) {
+		p->track->root_keys = p->stack[0].doc->tree_len;
+	}
+
+	return toml2_sections_add(p->track, tok->start, NULL);
+}
+
 // toml2_g_subfield sets the top frame to it's subfield, specified by the
 // current token. The top frame must be a table or untyped; in the latter 
 // case it is typed as a table. If the subfield doesn't exist, it is created
@@ -260,6 +623,10 @@ toml2_g_subfield(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
+	if (NULL == top->doc) {
+		// Anything under a value outside the paths is too.
+		return 0;
+	}
 
 	if (0 == top->doc->type) {
 		top->doc->type = TOML2_TABLE;
@@ -272,11 +639,13 @@ toml2_g_subfield(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 		}
 
 		if (0 != top->doc->ary_len) {
-			top->doc = &top->doc->ary[top->doc->ary_len - 1];
+			size_t last = top->doc->ary_len - 1;
+			top->proj = toml2_frame_proj_index(top->proj, last);
+			top->doc = &top->doc->ary[last];
 		}
 		else {
 			toml2_frame_t newtop;
-			int err = toml2_frame_push_slot(top, &newtop);
+			int err = toml2_frame_push_slot(p, top, &newtop);
 			if (0 != err) {
 				return err;
 			}
@@ -302,6 +671,12 @@ toml2_g_subfield(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 		return ret;
 	}
 
+	// The first part of a header's name is the child of the root it
+	// falls under.
+	if (NULL != p->track && top->doc == p->stack[0].doc) {
+		p->track->sections[p->track->len - 1].key = new.doc;
+	}
+
 	*top = new;
 	return 0;
 }
@@ -315,6 +690,9 @@ toml2_g_subtable(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
+	if (NULL == top->doc) {
+		return 0;
+	}
 
 	if (0 == top->doc->type) {
 		top->doc->type = TOML2_LIST;
@@ -329,7 +707,7 @@ toml2_g_subtable(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 
 	toml2_frame_t new;
 	int ret;
-   	if (0 != (ret = toml2_frame_push_slot(top, &new))) {
+   	if (0 != (ret = toml2_frame_push_slot(p, top, &new))) {
 		return ret;
 	}
 	new.doc->type = TOML2_TABLE;
@@ -348,6 +726,9 @@ toml2_g_endtable(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
+	if (NULL == top->doc) {
+		return 0;
+	}
 
 	if (0 == top->doc->type) {
 		// Force to a table to allow empty tables.
@@ -376,6 +757,9 @@ toml2_g_reset(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	}
 
 	p->stack[1] = p->stack[0];
+	if (NULL != p->track) {
+		return toml2_parse_track(p, tok);
+	}
 	return 0;
 }
 
@@ -388,18 +772,21 @@ toml2_g_name(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
-	if (0 == top->doc->type) {
-		top->doc->type = TOML2_TABLE;
-	}
-	else if (TOML2_TABLE != top->doc->type) {
-		return TOML2_INTERNAL_ERROR;
-	}
 
-	toml2_frame_t new;
+	toml2_frame_t new = { 0 };
 	int ret;
 
-	if (0 != (ret = toml2_frame_new_slot(p, top, &new, tok))) {
-		return ret;
+	if (NULL != top->doc) {
+		if (0 == top->doc->type) {
+			top->doc->type = TOML2_TABLE;
+		}
+		else if (TOML2_TABLE != top->doc->type) {
+			return TOML2_INTERNAL_ERROR;
+		}
+
+		if (0 != (ret = toml2_frame_new_slot(p, top, &new, tok))) {
+			return ret;
+		}
 	}
 
 	if (0 != (ret = toml2_parse_push(p, new))) {
@@ -417,12 +804,16 @@ toml2_g_save(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
+	if (NULL == top->doc) {
+		p->stack_len -= 1;
+		return 0;
+	}
 	if (0 != top->doc->type) {
 		return TOML2_VALUE_REASSIGNED;
 	}
 
 	int ret;
-	if (0 != (ret = toml2_frame_save(top, p->lex, tok))) {
+	if (0 != (ret = toml2_frame_save(p, top, tok))) {
 		return ret;
 	}
 
@@ -440,6 +831,9 @@ toml2_g_append(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	if (NULL == top) {
 		return TOML2_INTERNAL_ERROR;
 	}
+	if (NULL == top->doc) {
+		return 0;
+	}
 	if (0 == top->doc->type) {
 		top->doc->type = TOML2_LIST;
 	}
@@ -450,10 +844,10 @@ toml2_g_append(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 	toml2_frame_t new;
 	int ret;
 
-	if (0 != (ret = toml2_frame_push_slot(top, &new))) {
+	if (0 != (ret = toml2_frame_push_slot(p, top, &new))) {
 		return ret;
 	}
-	if (0 != (ret = toml2_frame_save(&new, p->lex, tok))) {
+	if (0 != (ret = toml2_frame_save(p, &new, tok))) {
 		return ret;
 	}
 
@@ -498,8 +892,19 @@ toml2_g_push(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 		return TOML2_INTERNAL_ERROR;
 	}
 
+	if (NULL == top->doc) {
+		// Skipping a value: there's no node to tell a key's frame from
+		// a list's, but only a value after a key replaces its frame.
+		bzero(&new, sizeof(new));
+		new.prev_mode = *m;
+		if (VALUE == *m || ITABLE_VAL == *m) {
+			p->stack_len -= 1;
+		}
+		return toml2_parse_push(p, new);
+	}
+
 	if (TOML2_LIST == top->doc->type) {
-		if (0 != (ret = toml2_frame_push_slot(top, &new))) {
+		if (0 != (ret = toml2_frame_push_slot(p, top, &new))) {
 			return ret;
 		}
 
@@ -565,235 +970,1744 @@ toml2_g_pop(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
 typedef int(*trans_t)(toml2_parse_t*, toml2_token_t*, toml2_parse_mode_t*);
 
 typedef struct {
-	toml2_token_type_t tok;
 	toml2_parse_mode_t next;
 	trans_t fn;
+
+	// event_fn stands in for fn with toml2_parse_events.
+	trans_t event_fn;
 }
 toml2_g_trans_t;
 
-typedef struct {
-	toml2_parse_mode_t mode;
-	toml2_g_trans_t transitions[10];
+// toml2_e_emit passes ev to the callback of toml2_parse_events, then drops
+// any strings that had to be decoded for it.
+static int
+toml2_e_emit(toml2_parse_t *p, toml2_event_t *ev)
+{
+	int ret = p->events(p->events_ctx, ev);
+	toml2_arena_free(p->arena);
+	return ret;
 }
-toml2_g_node_t;
 
-// This is where a smart person would pull in a parser generator or something.
-// Alas I am not a smart person.
-static const toml2_g_node_t toml2_g_tables[] = {
-	{ START_LINE, {
-		{ TOML2_TOKEN_BRACKET_OPEN,  TABLE_OR_ATABLE,  &toml2_g_reset       },
-		{ TOML2_TOKEN_IDENTIFIER,    VALUE_EQUALS,     &toml2_g_name        },
-		{ TOML2_TOKEN_STRING,        VALUE_EQUALS,     &toml2_g_name        },
-		{ TOML2_TOKEN_INT,           VALUE_EQUALS,     &toml2_g_name        },
-		{ TOML2_TOKEN_EOF,           DONE,             NULL                 },
-		{ TOML2_TOKEN_NEWLINE,       START_LINE,       NULL                 },
-		{0},
-	}},
-	{ TABLE_OR_ATABLE, {
-		{ TOML2_TOKEN_BRACKET_OPEN,  ATABLE_ID,        NULL                 },
-		{ TOML2_TOKEN_IDENTIFIER,    TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{ TOML2_TOKEN_STRING,        TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{ TOML2_TOKEN_INT,           TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{0},
-	}},
-	{ TABLE_ID, {
-		{ TOML2_TOKEN_IDENTIFIER,    TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{ TOML2_TOKEN_STRING,        TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{ TOML2_TOKEN_INT,           TABLE_DOT_OR_END, &toml2_g_subfield    },
-		{0},
-	}},
-	{ TABLE_DOT_OR_END, {
-		{ TOML2_TOKEN_DOT,           TABLE_ID,         NULL                 },
-		{ TOML2_TOKEN_BRACKET_CLOSE, NEWLINE,          &toml2_g_endtable    },
-		{0},
-	}},
-	{ ATABLE_ID, {
-		{ TOML2_TOKEN_IDENTIFIER,    ATABLE_DOT_OR_END, &toml2_g_subfield   },
-		{ TOML2_TOKEN_STRING,        ATABLE_DOT_OR_END, &toml2_g_subfield   },
-		{ TOML2_TOKEN_INT,           ATABLE_DOT_OR_END, &toml2_g_subfield   },
-		{0},
-	}},
-	{ ATABLE_DOT_OR_END, {
-		{ TOML2_TOKEN_DOT,           ATABLE_ID,        NULL                 },
-		{ TOML2_TOKEN_BRACKET_CLOSE, ATABLE_CLOSE,     NULL                 },
-		{0},
-	}},
-	{ ATABLE_CLOSE, {
-		{ TOML2_TOKEN_BRACKET_CLOSE, NEWLINE,          &toml2_g_subtable    },
-		{0},
-	}},
-	{ VALUE_EQUALS, {
-		{ TOML2_TOKEN_EQUALS,        VALUE,            NULL                 },
-		{0},
-	}},
-	{ VALUE, {
-		{ TOML2_TOKEN_STRING,        NEWLINE,           &toml2_g_save       },
-		{ TOML2_TOKEN_INT,           NEWLINE,           &toml2_g_save       },
-		{ TOML2_TOKEN_DOUBLE,        NEWLINE,           &toml2_g_save       },
-		{ TOML2_TOKEN_IDENTIFIER,    NEWLINE,           &toml2_g_save       },
-		{ TOML2_TOKEN_DATE,          NEWLINE,           &toml2_g_save       },
-		{ TOML2_TOKEN_BRACKET_OPEN,  IARRAY_VAL_OR_END, &toml2_g_push       },
-		{ TOML2_TOKEN_BRACE_OPEN,    ITABLE_ID_OR_END,  &toml2_g_push       },
-		{0},
-	}},
-	{ IARRAY_VAL_OR_END, {
-		{ TOML2_TOKEN_STRING,        IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_INT,           IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_DOUBLE,        IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_IDENTIFIER,    IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_DATE,          IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_BRACKET_OPEN,  IARRAY_VAL_OR_END, &toml2_g_push       },
-		{ TOML2_TOKEN_BRACE_OPEN,    ITABLE_ID_OR_END,  &toml2_g_push       },
-		{ TOML2_TOKEN_BRACKET_CLOSE, UNDEFINED,         &toml2_g_pop        },
-		{ TOML2_TOKEN_NEWLINE,       IARRAY_VAL_OR_END, NULL                },
-		{0},
-	}},
-	{ IARRAY_COM_OR_END, {
-		{ TOML2_TOKEN_COMMA,         IARRAY_VAL,        NULL                },
-		{ TOML2_TOKEN_BRACKET_CLOSE, UNDEFINED,         &toml2_g_pop        },
-		{ TOML2_TOKEN_NEWLINE,       IARRAY_COM_OR_END, NULL                },
-		{0},
-	}},
-	{ IARRAY_VAL, {
-		{ TOML2_TOKEN_STRING,        IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_INT,           IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_DOUBLE,        IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_IDENTIFIER,    IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_DATE,          IARRAY_COM_OR_END, &toml2_g_append     },
-		{ TOML2_TOKEN_BRACKET_OPEN,  IARRAY_VAL_OR_END, &toml2_g_push       },
-		{ TOML2_TOKEN_BRACE_OPEN,    ITABLE_ID_OR_END,  &toml2_g_push       },
-		{ TOML2_TOKEN_BRACKET_CLOSE, UNDEFINED,         &toml2_g_pop        },
-		{ TOML2_TOKEN_NEWLINE,       IARRAY_VAL,        NULL                },
-		{0},
-	}},
-	{ ITABLE_ID_OR_END, {
-		{ TOML2_TOKEN_IDENTIFIER,    ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_STRING,        ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_INT,           ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_BRACE_CLOSE,   UNDEFINED,          &toml2_g_pop       },
-		{ TOML2_TOKEN_NEWLINE,       ITABLE_ID_OR_END,   NULL               },
-		{0}
-	}},
-	{ ITABLE_EQUALS, {
-		{ TOML2_TOKEN_EQUALS,        ITABLE_VAL,         NULL               },
-		{ TOML2_TOKEN_NEWLINE,       ITABLE_EQUALS,      NULL               },
-		{0}
-	}},
-	{ ITABLE_VAL, {
-		{ TOML2_TOKEN_STRING,        ITABLE_COM_OR_END, &toml2_g_save       },
-		{ TOML2_TOKEN_INT,           ITABLE_COM_OR_END, &toml2_g_save       },
-		{ TOML2_TOKEN_DOUBLE,        ITABLE_COM_OR_END, &toml2_g_save       },
-		{ TOML2_TOKEN_IDENTIFIER,    ITABLE_COM_OR_END, &toml2_g_save       },
-		{ TOML2_TOKEN_DATE,          ITABLE_COM_OR_END, &toml2_g_save       },
-		{ TOML2_TOKEN_BRACKET_OPEN,  IARRAY_VAL_OR_END, &toml2_g_push       },
-		{ TOML2_TOKEN_BRACE_OPEN,    ITABLE_ID_OR_END,  &toml2_g_push       },
-		{ TOML2_TOKEN_NEWLINE,       ITABLE_VAL,        NULL                },
-		{0},
-	}},
-	{ ITABLE_COM_OR_END, {
-		{ TOML2_TOKEN_COMMA,         ITABLE_ID,         NULL                },
-		{ TOML2_TOKEN_BRACE_CLOSE,   UNDEFINED,         &toml2_g_pop        },
-		{ TOML2_TOKEN_NEWLINE,       ITABLE_COM_OR_END, NULL                },
-		{0},
-	}},
-	{ ITABLE_ID, {
-		{ TOML2_TOKEN_IDENTIFIER,    ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_STRING,        ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_INT,           ITABLE_EQUALS,      &toml2_g_name      },
-		{ TOML2_TOKEN_NEWLINE,       ITABLE_ID,          NULL               },
-		{0},
-	}},
-	{ NEWLINE, {
-		{ TOML2_TOKEN_NEWLINE,       START_LINE,       NULL                 },
-		{ TOML2_TOKEN_EOF,           DONE,             NULL                 },
-		{0},
-	}}
-};
-
-int
-toml2_parse(toml2_t *root, const char *data, size_t datalen)
+// toml2_e_key extracts the key in tok, which is a view into the input
+// unless it needs unescaping.
+static int
+toml2_e_key(toml2_parse_t *p, toml2_token_t *tok, toml2_key_t *key)
 {
-	int ret;
-	toml2_lex_t lexer;
-	toml2_parse_t parser;
-	toml2_token_t tok;
-	toml2_parse_mode_t mode = START_LINE;
-	toml2_frame_t root_frame = {
-		.doc = root,
-		.prev_mode = 0,
-	};
+	if (
+		TOML2_TOKEN_STRING != tok->type &&
+		TOML2_TOKEN_IDENTIFIER != tok->type &&
+		TOML2_TOKEN_INT != tok->type
+	) {
+		return TOML2_INTERNAL_ERROR;
+	}
 
-	// root node is always a table.
-	root->type = TOML2_TABLE;
+	bool borrowed;
+	key->name = toml2_parse_str(p, tok, &key->len, &borrowed);
+	if (NULL == key->name) {
+		return TOML2_NO_MEMORY;
+	}
 
-	toml2_parse_init(&parser, &lexer);
+	return 0;
+}
 
-	if (0 != (ret = toml2_lex_init(&lexer, data, datalen))) {
-		goto cleanup;
-	}
-	if (0 != (ret = toml2_parse_push(&parser, root_frame))) {
-		goto cleanup;
-	}
-	if (0 != (ret = toml2_parse_push(&parser, root_frame))) {
-		goto cleanup;
-	}
+// The toml2_e_* functions stand in for the toml2_g_* ones of the same name
+// with toml2_parse_events. The stack is kept the same way, for the sake of
+// toml2_g_pop, but its frames have no node.
 
-	size_t num_tables = sizeof(toml2_g_tables) / sizeof(toml2_g_node_t);
-	size_t num_trans = sizeof(toml2_g_tables[0].transitions) / sizeof(toml2_g_trans_t);
+static int
+toml2_e_reset(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	if (2 != p->stack_len) {
+		return TOML2_INTERNAL_ERROR;
+	}
 
-	do {
-		ret = toml2_lex_token(&lexer, &tok);
-		if (ret) {
-			goto cleanup;
-		}
+	p->path_len = 0;
+	return 0;
+}
 
-		if (TOML2_TOKEN_COMMENT == tok.type) {
-			continue;
+static int
+toml2_e_subfield(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	if (p->path_len == p->path_cap) {
+		size_t new_cap = 2 * p->path_cap + 4;
+		void *new_data = realloc(p->path, new_cap * sizeof(toml2_key_t));
+		if (NULL == new_data) {
+			return TOML2_NO_MEMORY;
 		}
 
-		const toml2_g_trans_t *next = NULL;
+		p->path = new_data;
+		p->path_cap = new_cap;
+	}
 
-		for (size_t i = 0; i < num_tables && NULL == next; i += 1) {
-			const toml2_g_node_t *tb = &toml2_g_tables[i];
-			if (tb->mode != mode) {
-				continue;
-			}
+	int ret = toml2_e_key(p, tok, &p->path[p->path_len]);
+	if (0 != ret) {
+		return ret;
+	}
 
-			for (size_t j = 0; j < num_trans; j += 1) {
-				const toml2_g_trans_t *tr = &tb->transitions[j];
-				if (tr->tok != tok.type) {
-					continue;
-				}
+	p->path_len += 1;
+	return 0;
+}
 
-				next = tr;
-				break;
-			}
-		}
-			
-		// BREAK HERE
-		if (NULL == next) {
-			ret = TOML2_PARSE_ERROR;
-			goto cleanup;
-		}
+static int
+toml2_e_endtable(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_event_t ev = {
+		.type = TOML2_EVENT_TABLE,
+		.path = p->path,
+		.path_len = p->path_len,
+	};
+	return toml2_e_emit(p, &ev);
+}
 
-		toml2_parse_mode_t orig_mode = mode;
+static int
+toml2_e_subtable(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_event_t ev = {
+		.type = TOML2_EVENT_ARRAY_TABLE,
+		.path = p->path,
+		.path_len = p->path_len,
+	};
+	return toml2_e_emit(p, &ev);
+}
 
-		if (NULL != next->fn) {
-			ret = next->fn(&parser, &tok, &mode);
-			if (0 != ret) {
-				goto cleanup;
-			}
-		}
+static int
+toml2_e_name(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_event_t ev = { .type = TOML2_EVENT_KEY };
+	toml2_frame_t new = { 0 };
+	int ret;
 
-		if (UNDEFINED != next->next && orig_mode == mode) {
-			mode = next->next;
-		}
+	if (0 != (ret = toml2_e_key(p, tok, &ev.key))) {
+		return ret;
+	}
+	if (0 != (ret = toml2_e_emit(p, &ev))) {
+		return ret;
 	}
-	while (DONE != mode);
 
-	cleanup: {
-		toml2_parse_free(&parser);
-		toml2_lex_free(&lexer);
+	return toml2_parse_push(p, new);
+}
+
+static int
+toml2_e_append(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_t value;
+	toml2_frame_t frame = { .doc = &value };
+	toml2_event_t ev = {
+		.type = TOML2_EVENT_VALUE,
+		.value = &value,
+	};
+	int ret;
+
+	toml2_init(&value);
+	if (0 != (ret = toml2_frame_save(p, &frame, tok))) {
 		return ret;
 	}
+
+	return toml2_e_emit(p, &ev);
+}
+
+static int
+toml2_e_save(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	int ret = toml2_e_append(p, tok, m);
+	if (0 != ret) {
+		return ret;
+	}
+
+	p->stack_len -= 1;
+	return 0;
+}
+
+static int
+toml2_e_push(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_event_t ev;
+	toml2_frame_t new = { .prev_mode = *m };
+	int ret;
+
+	if (TOML2_TOKEN_BRACKET_OPEN == tok->type) {
+		ev.type = TOML2_EVENT_ARRAY_BEGIN;
+	}
+	else if (TOML2_TOKEN_BRACE_OPEN == tok->type) {
+		ev.type = TOML2_EVENT_INLINE_TABLE_BEGIN;
+	}
+	else {
+		return TOML2_INTERNAL_ERROR;
+	}
+	if (0 != (ret = toml2_e_emit(p, &ev))) {
+		return ret;
+	}
+
+	// A value after a key takes the place of the key's frame; one in an
+	// array goes on top of the array's.
+	if (VALUE == *m || ITABLE_VAL == *m) {
+		if (1 == p->stack_len) {
+			return TOML2_INTERNAL_ERROR;
+		}
+		p->stack_len -= 1;
+	}
+
+	return toml2_parse_push(p, new);
+}
+
+static int
+toml2_e_pop(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *m)
+{
+	toml2_event_t ev = {
+		.type = TOML2_TOKEN_BRACKET_CLOSE == tok->type
+			? TOML2_EVENT_ARRAY_END
+			: TOML2_EVENT_INLINE_TABLE_END,
+	};
+
+	int ret = toml2_e_emit(p, &ev);
+	if (0 != ret) {
+		return ret;
+	}
+
+	return toml2_g_pop(p, tok, m);
+}
+
+// This is where a smart person would pull in a parser generator or something.
+// Alas I am not a smart person.
+//
+// The grammar is a dense [mode][token] table so that each token costs one
+// indexed load. Missing entries are zeroed: no next mode and no function,
+// which is a parse error. A transition with a function but no next mode
+// (toml2_g_pop) leaves the mode for the function to set. The last column is
+// each function's stand-in for toml2_parse_events.
+static const toml2_g_trans_t toml2_g_table[DONE + 1][TOML2_TOKEN_EOF + 1] = {
+	[START_LINE] = {
+		[TOML2_TOKEN_BRACKET_OPEN]  = { TABLE_OR_ATABLE,   &toml2_g_reset,    &toml2_e_reset    },
+		[TOML2_TOKEN_IDENTIFIER]    = { VALUE_EQUALS,      &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_STRING]        = { VALUE_EQUALS,      &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_INT]           = { VALUE_EQUALS,      &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_EOF]           = { DONE,              NULL,              NULL              },
+		[TOML2_TOKEN_NEWLINE]       = { START_LINE,        NULL,              NULL              },
+	},
+	[TABLE_OR_ATABLE] = {
+		[TOML2_TOKEN_BRACKET_OPEN]  = { ATABLE_ID,         NULL,              NULL              },
+		[TOML2_TOKEN_IDENTIFIER]    = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_STRING]        = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_INT]           = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+	},
+	[TABLE_ID] = {
+		[TOML2_TOKEN_IDENTIFIER]    = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_STRING]        = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_INT]           = { TABLE_DOT_OR_END,  &toml2_g_subfield, &toml2_e_subfield },
+	},
+	[TABLE_DOT_OR_END] = {
+		[TOML2_TOKEN_DOT]           = { TABLE_ID,          NULL,              NULL              },
+		[TOML2_TOKEN_BRACKET_CLOSE] = { NEWLINE,           &toml2_g_endtable, &toml2_e_endtable },
+	},
+	[ATABLE_ID] = {
+		[TOML2_TOKEN_IDENTIFIER]    = { ATABLE_DOT_OR_END, &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_STRING]        = { ATABLE_DOT_OR_END, &toml2_g_subfield, &toml2_e_subfield },
+		[TOML2_TOKEN_INT]           = { ATABLE_DOT_OR_END, &toml2_g_subfield, &toml2_e_subfield },
+	},
+	[ATABLE_DOT_OR_END] = {
+		[TOML2_TOKEN_DOT]           = { ATABLE_ID,         NULL,              NULL              },
+		[TOML2_TOKEN_BRACKET_CLOSE] = { ATABLE_CLOSE,      NULL,              NULL              },
+	},
+	[ATABLE_CLOSE] = {
+		[TOML2_TOKEN_BRACKET_CLOSE] = { NEWLINE,           &toml2_g_subtable, &toml2_e_subtable },
+	},
+	[VALUE_EQUALS] = {
+		[TOML2_TOKEN_EQUALS]        = { VALUE,             NULL,              NULL              },
+	},
+	[VALUE] = {
+		[TOML2_TOKEN_STRING]        = { NEWLINE,           &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_INT]           = { NEWLINE,           &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_DOUBLE]        = { NEWLINE,           &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_IDENTIFIER]    = { NEWLINE,           &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_DATE]          = { NEWLINE,           &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_BRACKET_OPEN]  = { IARRAY_VAL_OR_END, &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACE_OPEN]    = { ITABLE_ID_OR_END,  &toml2_g_push,     &toml2_e_push     },
+	},
+	[IARRAY_VAL_OR_END] = {
+		[TOML2_TOKEN_STRING]        = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_INT]           = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_DOUBLE]        = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_IDENTIFIER]    = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_DATE]          = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_BRACKET_OPEN]  = { IARRAY_VAL_OR_END, &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACE_OPEN]    = { ITABLE_ID_OR_END,  &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACKET_CLOSE] = { UNDEFINED,         &toml2_g_pop,      &toml2_e_pop      },
+		[TOML2_TOKEN_NEWLINE]       = { IARRAY_VAL_OR_END, NULL,              NULL              },
+	},
+	[IARRAY_COM_OR_END] = {
+		[TOML2_TOKEN_COMMA]         = { IARRAY_VAL,        NULL,              NULL              },
+		[TOML2_TOKEN_BRACKET_CLOSE] = { UNDEFINED,         &toml2_g_pop,      &toml2_e_pop      },
+		[TOML2_TOKEN_NEWLINE]       = { IARRAY_COM_OR_END, NULL,              NULL              },
+	},
+	[IARRAY_VAL] = {
+		[TOML2_TOKEN_STRING]        = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_INT]           = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_DOUBLE]        = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_IDENTIFIER]    = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_DATE]          = { IARRAY_COM_OR_END, &toml2_g_append,   &toml2_e_append   },
+		[TOML2_TOKEN_BRACKET_OPEN]  = { IARRAY_VAL_OR_END, &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACE_OPEN]    = { ITABLE_ID_OR_END,  &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACKET_CLOSE] = { UNDEFINED,         &toml2_g_pop,      &toml2_e_pop      },
+		[TOML2_TOKEN_NEWLINE]       = { IARRAY_VAL,        NULL,              NULL              },
+	},
+	[ITABLE_ID_OR_END] = {
+		[TOML2_TOKEN_IDENTIFIER]    = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_STRING]        = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_INT]           = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_BRACE_CLOSE]   = { UNDEFINED,         &toml2_g_pop,      &toml2_e_pop      },
+		[TOML2_TOKEN_NEWLINE]       = { ITABLE_ID_OR_END,  NULL,              NULL              },
+	},
+	[ITABLE_EQUALS] = {
+		[TOML2_TOKEN_EQUALS]        = { ITABLE_VAL,        NULL,              NULL              },
+		[TOML2_TOKEN_NEWLINE]       = { ITABLE_EQUALS,     NULL,              NULL              },
+	},
+	[ITABLE_VAL] = {
+		[TOML2_TOKEN_STRING]        = { ITABLE_COM_OR_END, &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_INT]           = { ITABLE_COM_OR_END, &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_DOUBLE]        = { ITABLE_COM_OR_END, &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_IDENTIFIER]    = { ITABLE_COM_OR_END, &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_DATE]          = { ITABLE_COM_OR_END, &toml2_g_save,     &toml2_e_save     },
+		[TOML2_TOKEN_BRACKET_OPEN]  = { IARRAY_VAL_OR_END, &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_BRACE_OPEN]    = { ITABLE_ID_OR_END,  &toml2_g_push,     &toml2_e_push     },
+		[TOML2_TOKEN_NEWLINE]       = { ITABLE_VAL,        NULL,              NULL              },
+	},
+	[ITABLE_COM_OR_END] = {
+		[TOML2_TOKEN_COMMA]         = { ITABLE_ID,         NULL,              NULL              },
+		[TOML2_TOKEN_BRACE_CLOSE]   = { UNDEFINED,         &toml2_g_pop,      &toml2_e_pop      },
+		[TOML2_TOKEN_NEWLINE]       = { ITABLE_COM_OR_END, NULL,              NULL              },
+	},
+	[ITABLE_ID] = {
+		[TOML2_TOKEN_IDENTIFIER]    = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_STRING]        = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_INT]           = { ITABLE_EQUALS,     &toml2_g_name,     &toml2_e_name     },
+		[TOML2_TOKEN_NEWLINE]       = { ITABLE_ID,         NULL,              NULL              },
+	},
+	[NEWLINE] = {
+		[TOML2_TOKEN_NEWLINE]       = { START_LINE,        NULL,              NULL              },
+		[TOML2_TOKEN_EOF]           = { DONE,              NULL,              NULL              },
+	},
+};
+
+// toml2_parse_begin readies p to parse into root, which is always a table.
+static int
+toml2_parse_begin(toml2_parse_t *p, toml2_t *root)
+{
+	int ret;
+	toml2_frame_t root_frame = {
+		.doc = root,
+		.prev_mode = 0,
+		.proj = p->proj,
+	};
+
+	// This also makes root a table.
+	toml2_root_t *state = toml2_root(root);
+	if (NULL == state) {
+		return TOML2_NO_MEMORY;
+	}
+	p->keys = &state->keys;
+
+	if (0 != (ret = toml2_parse_push(p, root_frame))) {
+		return ret;
+	}
+	if (0 != (ret = toml2_parse_push(p, root_frame))) {
+		return ret;
+	}
+
+	return 0;
+}
+
+// toml2_parse_sort fills in the sorted vector of every table under doc once
+// the parse is done. On the heap, sorted goes on the end of order, whose
+// allocation is resized to fit both exactly.
+static int
+toml2_parse_sort(toml2_parse_t *p, toml2_t *doc)
+{
+	if (TOML2_TABLE == doc->type && 0 != doc->tree_len) {
+		size_t n = doc->tree_len;
+
+		if (NULL != p->arena) {
+			doc->sorted = toml2_arena_alloc(p->arena, n * sizeof(toml2_t*));
+		}
+		else {
+			toml2_t **order = realloc(doc->order, 2 * n * sizeof(toml2_t*));
+			if (NULL != order) {
+				doc->order = order;
+				doc->order_cap = n;
+				doc->sorted = order + n;
+			}
+		}
+		if (NULL == doc->sorted) {
+			return TOML2_NO_MEMORY;
+		}
+
+		size_t i = 0;
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &doc->tree) {
+			doc->sorted[i] = child;
+			i += 1;
+
+			int ret = toml2_parse_sort(p, child);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+	}
+	else if (TOML2_LIST == doc->type) {
+		for (size_t i = 0; i < doc->ary_len; i += 1) {
+			int ret = toml2_parse_sort(p, &doc->ary[i]);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void (*toml2_parse_hook)(toml2_token_t *tok);
+
+// toml2_parse_step runs the grammar transition for tok out of *mode.
+static int
+toml2_parse_step(toml2_parse_t *p, toml2_token_t *tok, toml2_parse_mode_t *mode)
+{
+	if (NULL != toml2_parse_hook) {
+		toml2_parse_hook(tok);
+	}
+
+	const toml2_g_trans_t *next = &toml2_g_table[*mode][tok->type];
+
+	// BREAK HERE
+	if (UNDEFINED == next->next && NULL == next->fn) {
+		return TOML2_PARSE_ERROR;
+	}
+
+	toml2_parse_mode_t orig_mode = *mode;
+
+	if (NULL != next->fn) {
+		trans_t fn = NULL == p->events ? next->fn : next->event_fn;
+		if (NULL == fn) {
+			return TOML2_INTERNAL_ERROR;
+		}
+
+		int ret = fn(p, tok, mode);
+		if (0 != ret) {
+			return ret;
+		}
+	}
+
+	if (UNDEFINED != next->next && orig_mode == *mode) {
+		*mode = next->next;
+	}
+
+	return 0;
+}
+
+// toml2_exact_t is the state of TOML2_EXACT_SIZE moving a document out of the
+// arena it was parsed into. The new block holds every node first, then every
+// string, so that strings never leave alignment padding between nodes.
+typedef struct {
+	// data, datalen are the parsed buffer. With TOML2_ZERO_COPY, strings that
+	// point into it stay there.
+	const char *data;
+	size_t datalen;
+
+	// nodes_len, strs_len are the sizes of the two parts of the block.
+	size_t nodes_len, strs_len;
+
+	// nodes, strs are where the next node and string are copied to.
+	char *nodes, *strs;
+
+	// keys is the document's key table. Names are copied once each, along
+	// with the table, rather than once per node.
+	toml2_intern_t *keys;
+}
+toml2_exact_t;
+
+// toml2_exact_owned returns whether str was copied out of the parsed buffer,
+// and so has to move along with the document.
+static bool
+toml2_exact_owned(toml2_exact_t *x, const char *str)
+{
+	uintptr_t s = (uintptr_t) str;
+	uintptr_t d = (uintptr_t) x->data;
+	return NULL != str && (s < d || s >= d + x->datalen);
+}
+
+// toml2_exact_count adds the space taken by everything doc refers to, but not
+// doc itself or its name, to the sizes in x. Copied strings carry a NUL
+// terminator.
+static void
+toml2_exact_count(toml2_exact_t *x, toml2_t *doc)
+{
+	if (TOML2_TABLE == doc->type) {
+		if (NULL != doc->hash) {
+			x->nodes_len += toml2_hash_size(doc->tree_len);
+		}
+		x->nodes_len += 2 * doc->tree_len * sizeof(toml2_t*);
+
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &doc->tree) {
+			x->nodes_len += sizeof(toml2_t);
+			toml2_exact_count(x, child);
+		}
+	}
+	else if (TOML2_LIST == doc->type) {
+		x->nodes_len += doc->ary_len * sizeof(toml2_t);
+		for (size_t i = 0; i < doc->ary_len; i += 1) {
+			toml2_exact_count(x, &doc->ary[i]);
+		}
+	}
+	else if (TOML2_STRING == doc->type && toml2_exact_owned(x, doc->sval)) {
+		x->strs_len += doc->sval_len + 1;
+	}
+}
+
+// toml2_exact_str returns where str lives once the document has moved.
+static const char*
+toml2_exact_str(toml2_exact_t *x, const char *str, size_t len)
+{
+	if (!toml2_exact_owned(x, str)) {
+		return str;
+	}
+
+	char *dst = x->strs;
+	memcpy(dst, str, len + 1);
+	x->strs += len + 1;
+	return dst;
+}
+
+// toml2_exact_copy makes dst a copy of src, with everything src refers to
+// copied into the block in x.
+static void
+toml2_exact_copy(toml2_exact_t *x, toml2_t *dst, toml2_t *src)
+{
+	*dst = *src;
+	if (toml2_exact_owned(x, src->name)) {
+		dst->name = toml2_intern_find(x->keys, src->name, src->name_len);
+	}
+
+	if (TOML2_TABLE == src->type) {
+		RB_INIT(&dst->tree);
+		if (NULL != src->hash) {
+			dst->hash = (toml2_hash_t*) x->nodes;
+			x->nodes += toml2_hash_size(src->tree_len);
+			toml2_hash_init(dst->hash, src->tree_len);
+		}
+
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &src->tree) {
+			toml2_t *copy = (toml2_t*) x->nodes;
+			x->nodes += sizeof(toml2_t);
+
+			toml2_exact_copy(x, copy, child);
+			RB_INSERT(toml2_tree_t, &dst->tree, copy);
+			if (NULL != dst->hash) {
+				toml2_hash_add(dst->hash, copy);
+			}
+		}
+
+		size_t n = src->tree_len;
+		dst->order = NULL;
+		dst->sorted = NULL;
+		dst->order_cap = n;
+		if (0 != n) {
+			dst->order = (toml2_t**) x->nodes;
+			dst->sorted = dst->order + n;
+			x->nodes += 2 * n * sizeof(toml2_t*);
+
+			size_t i = 0;
+			RB_FOREACH(child, toml2_tree_t, &dst->tree) {
+				dst->sorted[i] = child;
+				i += 1;
+			}
+			for (i = 0; i < n; i += 1) {
+				dst->order[i] = RB_FIND(toml2_tree_t, &dst->tree, src->order[i]);
+			}
+		}
+	}
+	else if (TOML2_LIST == src->type) {
+		dst->ary = 0 != src->ary_len ? (toml2_t*) x->nodes : NULL;
+		dst->ary_cap = src->ary_len;
+		x->nodes += src->ary_len * sizeof(toml2_t);
+
+		for (size_t i = 0; i < src->ary_len; i += 1) {
+			toml2_exact_copy(x, &dst->ary[i], &src->ary[i]);
+		}
+	}
+	else if (TOML2_STRING == src->type) {
+		dst->sval = toml2_exact_str(x, src->sval, src->sval_len);
+	}
+}
+
+// toml2_parse_exact moves root, freshly parsed into its arena, into a single
+// block of exactly the size it needs (see TOML2_EXACT_SIZE).
+static int
+toml2_parse_exact(toml2_t *root, const char *data, size_t datalen)
+{
+	toml2_root_t *state = root->root;
+	toml2_exact_t x = {
+		.data = data,
+		.datalen = datalen,
+		.keys = &state->keys,
+	};
+
+	x.strs_len = state->keys.strs_len;
+	toml2_exact_count(&x, root);
+
+	toml2_arena_t scratch = state->arena;
+	bzero(&state->arena, sizeof(state->arena));
+
+	char *block = toml2_arena_alloc_block(&state->arena, x.nodes_len + x.strs_len);
+	if (NULL == block) {
+		state->arena = scratch;
+		return TOML2_NO_MEMORY;
+	}
+
+	x.nodes = block;
+	x.strs = block + x.nodes_len;
+	toml2_intern_move(&state->keys, x.strs);
+	x.strs += state->keys.strs_len;
+
+	// The copy of the root goes back where it came from, so work from a
+	// snapshot of it; its children stay put until scratch is freed.
+	toml2_t src = *root;
+	toml2_exact_copy(&x, root, &src);
+	toml2_arena_free(&scratch);
+
+	// Nothing more will be added to the key table, and its copies of the
+	// names are now the ones in the block.
+	toml2_intern_free(&state->keys);
+
+	if (x.nodes != block + x.nodes_len || x.strs != x.nodes + x.strs_len) {
+		return TOML2_INTERNAL_ERROR;
+	}
+
+	return 0;
+}
+
+static int toml2_parse_proj(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	int flags,
+	const toml2_proj_t *proj,
+	const toml2_tokens_t *toks
+);
+
+int
+toml2_parse(toml2_t *root, const char *data, size_t datalen)
+{
+	return toml2_parse_flags(root, data, datalen, 0);
+}
+
+int
+toml2_parse_flags(toml2_t *root, const char *data, size_t datalen, int flags)
+{
+	return toml2_parse_proj(root, data, datalen, flags, NULL, NULL);
+}
+
+int
+toml2_parse_paths(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	int flags,
+	const char *const *paths,
+	size_t paths_len
+) {
+	toml2_proj_t proj = { 0 };
+	int ret = TOML2_NO_MEMORY;
+
+	if (0 == toml2_proj_init(&proj, paths, paths_len)) {
+		ret = toml2_parse_proj(
+			root,
+			data,
+			datalen,
+			flags,
+			proj.all ? NULL : &proj,
+			NULL
+		);
+	}
+
+	toml2_proj_free(&proj);
+	return ret;
+}
+
+// toml2_parse_proj is toml2_parse_flags, building only what matches proj if
+// it isn't NULL (see toml2_parse_paths), and taking the tokens from toks if
+// that isn't (see toml2_parse_tokens).
+static int
+toml2_parse_proj(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	int flags,
+	const toml2_proj_t *proj,
+	const toml2_tokens_t *toks
+) {
+	int ret;
+	toml2_lex_t lexer;
+	toml2_parse_t parser;
+	toml2_token_t tok = { 0 };
+	toml2_parse_mode_t mode = START_LINE;
+
+	if (flags & TOML2_LAZY) {
+		flags |= TOML2_ZERO_COPY;
+	}
+
+	toml2_parse_init(&parser, &lexer, flags);
+	parser.proj = proj;
+	parser.toks = toks;
+
+	toml2_root_t *state = toml2_root(root);
+	if (NULL == state) {
+		toml2_lex_init(&lexer, NULL, 0);
+		ret = TOML2_NO_MEMORY;
+		goto cleanup;
+	}
+	state->err = (toml2_err_t) { 0 };
+
+	if (0 != (ret = toml2_lex_init(&lexer, data, datalen))) {
+		goto cleanup;
+	}
+	lexer.lazy = flags & TOML2_LAZY;
+	if (flags & (TOML2_ARENA | TOML2_EXACT_SIZE)) {
+		parser.arena = &state->arena;
+	}
+
+	// toml2_reparse can only update a document in place if it can free
+	// parts of it, they don't point into the buffer, and it's all there.
+	if (
+		0 == (flags & (TOML2_ZERO_COPY | TOML2_ARENA | TOML2_EXACT_SIZE)) &&
+		NULL == proj
+	) {
+		parser.track = &state->sections;
+	}
+
+	if (0 != (ret = toml2_parse_begin(&parser, root))) {
+		goto cleanup;
+	}
+
+	do {
+		ret = NULL == toks
+			? toml2_parse_next(&parser, &tok)
+			: toml2_parse_next_tok(&parser, &tok);
+		if (0 != ret) {
+			goto cleanup;
+		}
+		if (0 != (ret = toml2_parse_step(&parser, &tok, &mode))) {
+			goto cleanup;
+		}
+	}
+	while (DONE != mode);
+
+	if (0 != (ret = toml2_parse_sort(&parser, root))) {
+		goto cleanup;
+	}
+	if (flags & TOML2_EXACT_SIZE) {
+		if (0 != (ret = toml2_parse_exact(root, data, datalen))) {
+			goto cleanup;
+		}
+	}
+
+	state->flags = flags;
+	state->len = datalen;
+	state->keys_len = state->keys.strs_len;
+	state->reparse_ok = NULL != parser.track;
+
+	cleanup: {
+		if (0 != ret && NULL != state) {
+			toml2_parse_locate(&lexer, &tok, ret);
+			state->err = lexer.err;
+		}
+		toml2_parse_free(&parser);
+		toml2_lex_free(&lexer);
+		return ret;
+	}
+}
+
+int
+toml2_parse_tokens(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	const toml2_tokens_t *toks
+) {
+	return toml2_parse_proj(root, data, datalen, 0, NULL, toks);
+}
+
+int
+toml2_parse_events(
+	const char *data,
+	size_t datalen,
+	toml2_event_fn_t fn,
+	void *ctx
+) {
+	int ret;
+	toml2_lex_t lexer;
+	toml2_parse_t parser;
+	toml2_token_t tok;
+	toml2_parse_mode_t mode = START_LINE;
+	toml2_arena_t scratch = { 0 };
+	toml2_frame_t root_frame = { 0 };
+
+	// Tokens are lexed one at a time, so that nothing grows with the
+	// document. Keys and strings point into data where they can, and
+	// otherwise are decoded into scratch, which is emptied after each
+	// event.
+	toml2_parse_init(&parser, &lexer, TOML2_ZERO_COPY);
+	parser.arena = &scratch;
+	parser.events = fn;
+	parser.events_ctx = ctx;
+
+	if (0 != (ret = toml2_lex_init(&lexer, data, datalen))) {
+		goto cleanup;
+	}
+	if (0 != (ret = toml2_parse_push(&parser, root_frame))) {
+		goto cleanup;
+	}
+	if (0 != (ret = toml2_parse_push(&parser, root_frame))) {
+		goto cleanup;
+	}
+
+	do {
+		if (0 != (ret = toml2_parse_next(&parser, &tok))) {
+			goto cleanup;
+		}
+		if (0 != (ret = toml2_parse_step(&parser, &tok, &mode))) {
+			goto cleanup;
+		}
+	}
+	while (DONE != mode);
+
+	cleanup: {
+		toml2_parse_free(&parser);
+		toml2_lex_free(&lexer);
+		toml2_arena_free(&scratch);
+		return ret;
+	}
+}
+
+// toml2_reparse_full is the fallback for toml2_reparse: it throws doc away
+// and parses data from scratch, with the flags doc was parsed with.
+static int
+toml2_reparse_full(toml2_t *doc, const char *data, size_t datalen)
+{
+	int flags = 0;
+	if (TOML2_TABLE == doc->type && NULL != doc->root) {
+		flags = doc->root->flags;
+	}
+
+	toml2_free(doc);
+	toml2_init(doc);
+	return toml2_parse_flags(doc, data, datalen, flags);
+}
+
+// toml2_sections_before returns the number of sections in t that start
+// before pos.
+static size_t
+toml2_sections_before(const toml2_sections_t *t, size_t pos)
+{
+	size_t lo = 0, hi = t->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (t->sections[mid].start < pos) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int
+toml2_reparse_cmp_ptr(const void *lhs, const void *rhs)
+{
+	uintptr_t l = (uintptr_t) *(toml2_t* const*) lhs;
+	uintptr_t r = (uintptr_t) *(toml2_t* const*) rhs;
+	return (l > r) - (l < r);
+}
+
+// toml2_reparse_key sets *key to the child of root named by tok, or NULL if
+// there isn't one.
+static int
+toml2_reparse_key(
+	toml2_t *root,
+	toml2_lex_t *lex,
+	toml2_token_t *tok,
+	toml2_t **key
+) {
+	toml2_t proto = {0};
+	char *tmp = NULL;
+	proto.name = toml2_token_view(lex, tok, &proto.name_len);
+	if (NULL == proto.name) {
+		tmp = toml2_token_utf8_len(lex, tok, &proto.name_len);
+		if (NULL == tmp) {
+			return TOML2_NO_MEMORY;
+		}
+		proto.name = tmp;
+	}
+
+	*key = RB_FIND(toml2_tree_t, &root->tree, &proto);
+	free(tmp);
+	return 0;
+}
+
+// toml2_reparse_scan lexes data from from, which is the start of a table
+// header, to find the headers that follow without parsing anything. Each
+// goes on the end of out, along with the child of root its name falls
+// under, or NULL if root has no such child. A header is a '[' at the start
+// of a line and outside of any value. Once one turns up where an old
+// header past the edits, old->sections[j] for j >= after, has moved to
+// (delta bytes on), everything from there is known to be unchanged: the
+// scan stops there and sets *resync to j. Otherwise it runs to the end and
+// sets *resync to old->len.
+static int
+toml2_reparse_scan(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	size_t from,
+	const toml2_sections_t *old,
+	size_t after,
+	size_t delta,
+	toml2_sections_t *out,
+	size_t *resync
+) {
+	toml2_lex_t lex;
+	toml2_token_t tok = { 0 };
+	size_t j = after;
+	size_t depth = 0;
+	bool line_start = true, want_key = false;
+
+	*resync = old->len;
+	int ret = toml2_lex_init(&lex, data + from, datalen - from);
+	while (0 == ret) {
+		if (0 != (ret = toml2_lex_token(&lex, &tok))) {
+			break;
+		}
+		if (TOML2_TOKEN_EOF == tok.type) {
+			break;
+		}
+		if (TOML2_TOKEN_COMMENT == tok.type) {
+			continue;
+		}
+		if (TOML2_TOKEN_NEWLINE == tok.type) {
+			line_start = 0 == depth;
+			want_key = false;
+			continue;
+		}
+
+		bool header = line_start && 0 == depth;
+		line_start = false;
+
+		if (want_key) {
+			// Skip the second '[' of an array of tables to get to the
+			// first part of the name.
+			if (TOML2_TOKEN_BRACKET_OPEN == tok.type) {
+				continue;
+			}
+
+			want_key = false;
+			if (
+				TOML2_TOKEN_STRING == tok.type ||
+				TOML2_TOKEN_IDENTIFIER == tok.type ||
+				TOML2_TOKEN_INT == tok.type
+			) {
+				ret = toml2_reparse_key(
+					root,
+					&lex,
+					&tok,
+					&out->sections[out->len - 1].key
+				);
+			}
+		}
+		else if (TOML2_TOKEN_BRACKET_OPEN == tok.type && header) {
+			size_t pos = from + tok.start;
+			while (j < old->len && old->sections[j].start + delta < pos) {
+				j += 1;
+			}
+			if (j < old->len && old->sections[j].start + delta == pos) {
+				*resync = j;
+				break;
+			}
+
+			ret = toml2_sections_add(out, pos, NULL);
+			want_key = true;
+		}
+		else if (
+			TOML2_TOKEN_BRACKET_OPEN == tok.type ||
+			TOML2_TOKEN_BRACE_OPEN == tok.type
+		) {
+			depth += 1;
+		}
+		else if (
+			(TOML2_TOKEN_BRACKET_CLOSE == tok.type ||
+			TOML2_TOKEN_BRACE_CLOSE == tok.type) &&
+			0 != depth
+		) {
+			depth -= 1;
+		}
+	}
+
+	if (0 != ret) {
+		toml2_parse_locate(&lex, &tok, ret);
+		root->root->err = lex.err;
+	}
+	toml2_lex_free(&lex);
+	return ret;
+}
+
+// toml2_reparse_locate moves the position of the error in state, which came
+// from lexing data from offset from on its own, to count from the top of
+// data.
+static void
+toml2_reparse_locate(toml2_root_t *state, const char *data, size_t from)
+{
+	if (0 == state->err.line) {
+		return;
+	}
+
+	size_t lines = 0, line_start = 0;
+	for (;;) {
+		size_t nl = toml2_scan_newline(data + line_start, from - line_start);
+		if (line_start + nl == from) {
+			break;
+		}
+
+		lines += 1;
+		line_start += nl + 1;
+	}
+
+	if (1 == state->err.line) {
+		state->err.col += from - line_start;
+	}
+	state->err.line += lines;
+}
+
+// toml2_reparse_intern adds the names of node's children, and everything
+// under them, to keys.
+static int
+toml2_reparse_intern(toml2_t *node, toml2_intern_t *keys)
+{
+	if (TOML2_TABLE == node->type) {
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &node->tree) {
+			if (NULL == toml2_intern(keys, child->name, child->name_len)) {
+				return TOML2_NO_MEMORY;
+			}
+			if (0 != toml2_reparse_intern(child, keys)) {
+				return TOML2_NO_MEMORY;
+			}
+		}
+	}
+	else if (TOML2_LIST == node->type) {
+		for (size_t i = 0; i < node->ary_len; i += 1) {
+			if (0 != toml2_reparse_intern(&node->ary[i], keys)) {
+				return TOML2_NO_MEMORY;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// toml2_reparse_rename points the names of node's children, and everything
+// under them, at their copies in keys.
+static void
+toml2_reparse_rename(toml2_t *node, toml2_intern_t *keys)
+{
+	if (TOML2_TABLE == node->type) {
+		toml2_t *child;
+		RB_FOREACH(child, toml2_tree_t, &node->tree) {
+			child->name = toml2_intern_find(keys, child->name, child->name_len);
+			toml2_reparse_rename(child, keys);
+		}
+	}
+	else if (TOML2_LIST == node->type) {
+		for (size_t i = 0; i < node->ary_len; i += 1) {
+			toml2_reparse_rename(&node->ary[i], keys);
+		}
+	}
+}
+
+// toml2_reparse_rekey replaces doc's key table with one holding only the
+// names doc still uses. If memory runs out, the old one is kept.
+static void
+toml2_reparse_rekey(toml2_t *doc, toml2_root_t *state)
+{
+	toml2_intern_t keys = { 0 };
+	if (0 != toml2_reparse_intern(doc, &keys)) {
+		toml2_intern_free(&keys);
+		return;
+	}
+
+	toml2_reparse_rename(doc, &keys);
+	toml2_intern_free(&state->keys);
+	state->keys = keys;
+	state->keys_len = keys.strs_len;
+}
+
+// toml2_reparse_section parses the datalen bytes at data, one section of a
+// document, into root, adding its header to track.
+static int
+toml2_reparse_section(
+	toml2_t *root,
+	const char *data,
+	size_t datalen,
+	int flags,
+	toml2_sections_t *track
+) {
+	int ret;
+	toml2_lex_t lexer;
+	toml2_parse_t parser;
+	toml2_token_t tok = { 0 };
+	toml2_parse_mode_t mode = START_LINE;
+
+	toml2_parse_init(&parser, &lexer, flags);
+	parser.track = track;
+	if (0 != (ret = toml2_lex_init(&lexer, data, datalen))) {
+		goto cleanup;
+	}
+	if (0 != (ret = toml2_parse_begin(&parser, root))) {
+		goto cleanup;
+	}
+
+	do {
+		if (0 != (ret = toml2_parse_next(&parser, &tok))) {
+			goto cleanup;
+		}
+		if (0 != (ret = toml2_parse_step(&parser, &tok, &mode))) {
+			goto cleanup;
+		}
+	}
+	while (DONE != mode);
+
+	cleanup: {
+		if (0 != ret) {
+			toml2_parse_locate(&lexer, &tok, ret);
+			root->root->err = lexer.err;
+		}
+		toml2_parse_free(&parser);
+		toml2_lex_free(&lexer);
+		return ret;
+	}
+}
+
+int
+toml2_reparse(
+	toml2_t *doc,
+	const char *data,
+	size_t datalen,
+	const toml2_edit_t *edits,
+	size_t edits_len
+) {
+	toml2_root_t *state = TOML2_TABLE == doc->type ? doc->root : NULL;
+	if (NULL == state || !state->reparse_ok || 0 == state->sections.len) {
+		return toml2_reparse_full(doc, data, datalen);
+	}
+	state->err = (toml2_err_t) { 0 };
+
+	size_t end = 0, shrink = 0, grow = 0;
+	for (size_t i = 0; i < edits_len; i += 1) {
+		const toml2_edit_t *e = &edits[i];
+		if (
+			e->offset < end ||
+			e->offset > state->len ||
+			e->old_len > state->len - e->offset
+		) {
+			errno = EINVAL;
+			state->err = (toml2_err_t) { .err = TOML2_ERRNO, .code = errno };
+			return TOML2_ERRNO;
+		}
+
+		end = e->offset + e->old_len;
+		shrink += e->old_len;
+		grow += e->new_len;
+	}
+	if (state->len - shrink + grow != datalen) {
+		errno = EINVAL;
+		state->err = (toml2_err_t) { .err = TOML2_ERRNO, .code = errno };
+		return TOML2_ERRNO;
+	}
+	if (0 == edits_len) {
+		return 0;
+	}
+
+	// Only sections that start before the first edit are known to begin
+	// the same way, so the one the first edit falls in is the earliest
+	// that might differ. Edits before any header reach the root's own keys,
+	// which are simplest to parse from scratch.
+	toml2_sections_t *old = &state->sections;
+	size_t lo = edits[0].offset, hi = end;
+	if (lo <= old->sections[0].start) {
+		return toml2_reparse_full(doc, data, datalen);
+	}
+
+	int ret = 0;
+	bool fallback = false;
+	size_t delta = datalen - state->len;
+	size_t a = toml2_sections_before(old, lo) - 1;
+	size_t after = toml2_sections_before(old, hi + 1);
+	size_t resync;
+	toml2_sections_t found = { 0 };
+	toml2_sections_t track = { 0 };
+	toml2_section_t *merged = NULL;
+	toml2_t **gone = NULL;
+	toml2_t **order = NULL;
+	toml2_hash_t *seen = NULL;
+
+	ret = toml2_reparse_scan(
+		doc,
+		data,
+		datalen,
+		old->sections[a].start,
+		old,
+		after,
+		delta,
+		&found,
+		&resync
+	);
+	if (0 != ret) {
+		toml2_reparse_locate(state, data, old->sections[a].start);
+		goto cleanup;
+	}
+	if (0 == found.len || old->sections[a].start != found.sections[0].start) {
+		fallback = true;
+		goto cleanup;
+	}
+
+	// Every section in the changed region, old or new, is parsed again,
+	// along with every other section under the same root keys: gone lists
+	// those keys, whose tables are rebuilt from scratch.
+	size_t gone_len = 0;
+	gone = malloc((resync - a + found.len) * sizeof(toml2_t*));
+	if (NULL == gone) {
+		ret = TOML2_NO_MEMORY;
+		goto cleanup;
+	}
+	for (size_t i = a; i < resync; i += 1) {
+		if (NULL != old->sections[i].key) {
+			gone[gone_len++] = old->sections[i].key;
+		}
+	}
+	for (size_t i = 0; i < found.len; i += 1) {
+		if (NULL != found.sections[i].key) {
+			gone[gone_len++] = found.sections[i].key;
+		}
+	}
+	qsort(gone, gone_len, sizeof(toml2_t*), &toml2_reparse_cmp_ptr);
+
+	size_t uniq = 0;
+	for (size_t i = 0; i < gone_len; i += 1) {
+		if (0 == uniq || gone[uniq - 1] != gone[i]) {
+			gone[uniq++] = gone[i];
+		}
+	}
+	gone_len = uniq;
+
+	// Tables that the root's own keys also add to can't be rebuilt from
+	// their sections alone.
+	for (size_t i = 0; i < old->root_keys; i += 1) {
+		if (NULL != bsearch(&doc->order[i], gone, gone_len, sizeof(toml2_t*), &toml2_reparse_cmp_ptr)) {
+			fallback = true;
+			goto cleanup;
+		}
+	}
+
+	// The new layout is the old one with the changed region swapped out,
+	// and the sections after it moved. Sections with no key yet are the
+	// ones to parse.
+	size_t n = a + found.len + (old->len - resync);
+	merged = malloc(n * sizeof(toml2_section_t));
+	if (NULL == merged) {
+		ret = TOML2_NO_MEMORY;
+		goto cleanup;
+	}
+
+	size_t k = 0;
+	for (size_t i = 0; i < old->len; i += 1) {
+		if (i == a) {
+			for (size_t f = 0; f < found.len; f += 1) {
+				merged[k].start = found.sections[f].start;
+				merged[k].key = NULL;
+				k += 1;
+			}
+			i = resync - 1;
+			continue;
+		}
+
+		toml2_t *key = old->sections[i].key;
+		if (NULL != bsearch(&key, gone, gone_len, sizeof(toml2_t*), &toml2_reparse_cmp_ptr)) {
+			key = NULL;
+		}
+
+		merged[k].start = old->sections[i].start + (i < a ? 0 : delta);
+		merged[k].key = key;
+		k += 1;
+	}
+
+	// From here on doc is changed, so any failure leaves it only fit to be
+	// freed. Drop the tables being rebuilt, keeping the rest in order.
+	state->reparse_ok = false;
+
+	size_t kept = 0;
+	for (size_t i = 0; i < doc->tree_len; i += 1) {
+		toml2_t *child = doc->order[i];
+		if (NULL == bsearch(&child, gone, gone_len, sizeof(toml2_t*), &toml2_reparse_cmp_ptr)) {
+			doc->order[kept++] = child;
+		}
+	}
+	for (size_t i = 0; i < gone_len; i += 1) {
+		RB_REMOVE(toml2_tree_t, &doc->tree, gone[i]);
+		toml2_free(gone[i]);
+		free(gone[i]);
+	}
+	doc->tree_len = kept;
+	doc->sorted = NULL;
+
+	if (NULL != doc->hash) {
+		free(doc->hash);
+		doc->hash = NULL;
+		for (size_t i = 0; i < kept; i += 1) {
+			if (0 != toml2_hash_reserve(&doc->hash, NULL)) {
+				ret = TOML2_NO_MEMORY;
+				goto cleanup;
+			}
+			toml2_hash_add(doc->hash, doc->order[i]);
+		}
+	}
+
+	for (size_t i = 0; i < n; i += 1) {
+		if (NULL != merged[i].key) {
+			continue;
+		}
+
+		size_t start = merged[i].start;
+		size_t stop = i + 1 < n ? merged[i + 1].start : datalen;
+		ret = toml2_reparse_section(doc, data + start, stop - start, state->flags, &track);
+		if (0 != ret) {
+			toml2_reparse_locate(state, data, start);
+			goto cleanup;
+		}
+		if (1 != track.len || NULL == track.sections[0].key) {
+			ret = TOML2_INTERNAL_ERROR;
+			goto cleanup;
+		}
+
+		merged[i].key = track.sections[0].key;
+		track.len = 0;
+	}
+
+	toml2_parse_t sorter;
+	toml2_parse_init(&sorter, NULL, state->flags);
+	for (size_t i = kept; i < doc->tree_len; i += 1) {
+		if (0 != (ret = toml2_parse_sort(&sorter, doc->order[i]))) {
+			goto cleanup;
+		}
+	}
+
+	// The root's order vector is rebuilt in document order: its own keys
+	// first, then each section's key where it first appears.
+	size_t len = doc->tree_len;
+	order = malloc(2 * len * sizeof(toml2_t*));
+	if (NULL == order) {
+		ret = TOML2_NO_MEMORY;
+		goto cleanup;
+	}
+
+	k = 0;
+	for (size_t i = 0; i < old->root_keys + n; i += 1) {
+		toml2_t *key = i < old->root_keys
+			? doc->order[i]
+			: merged[i - old->root_keys].key;
+		if (0 != toml2_hash_reserve(&seen, NULL)) {
+			ret = TOML2_NO_MEMORY;
+			goto cleanup;
+		}
+		if (NULL == toml2_hash_find(seen, key->name, key->name_len)) {
+			toml2_hash_add(seen, key);
+			order[k++] = key;
+		}
+	}
+	if (k != len) {
+		ret = TOML2_INTERNAL_ERROR;
+		goto cleanup;
+	}
+
+	k = 0;
+	toml2_t *child;
+	RB_FOREACH(child, toml2_tree_t, &doc->tree) {
+		order[len + k] = child;
+		k += 1;
+	}
+
+	free(doc->order);
+	doc->order = order;
+	doc->order_cap = len;
+	doc->sorted = order + len;
+	order = NULL;
+
+	free(old->sections);
+	old->sections = merged;
+	old->len = n;
+	old->cap = n;
+	merged = NULL;
+
+	state->len = datalen;
+	state->reparse_ok = true;
+
+	// Each reparse adds the names it finds to the key table, in use or
+	// not. Once that's grown by more than the document, it's worth a walk
+	// over the tree to start again with just the names still there.
+	if (state->keys.strs_len - state->keys_len > datalen) {
+		toml2_reparse_rekey(doc, state);
+	}
+
+	cleanup: {
+		free(found.sections);
+		free(track.sections);
+		free(merged);
+		free(gone);
+		free(order);
+		free(seen);
+		if (fallback) {
+			return toml2_reparse_full(doc, data, datalen);
+		}
+		return ret;
+	}
+}
+
+typedef struct toml2_stream_t toml2_stream_t;
+
+// toml2_stream_t is the state of an in-progress toml2_parse_feed.
+struct toml2_stream_t {
+	toml2_lex_t lex;
+	toml2_parse_t parser;
+	toml2_parse_mode_t mode;
+
+	// buf holds the input from the lexer's position onwards: the start of
+	// whatever token is still incomplete, plus anything fed after it.
+	char *buf;
+	size_t buf_len, buf_cap;
+
+	// valid is how many bytes of buf are known to be well-formed UTF-8;
+	// a multi-byte sequence split between chunks is checked once complete.
+	size_t valid;
+
+	// retry is the buf_len to wait for before trying to finish an
+	// incomplete token again. Waiting for the buffer to double keeps a
+	// token that spans many small chunks from being rescanned every time.
+	size_t retry;
+
+	// err is sticky: once a feed fails, every later call returns it.
+	int err;
+};
+
+static void
+toml2_stream_free(toml2_stream_t *st)
+{
+	if (NULL == st) {
+		return;
+	}
+
+	toml2_parse_free(&st->parser);
+	toml2_lex_free(&st->lex);
+	free(st->buf);
+	free(st);
+}
+
+// toml2_stream_complete says whether the token lexed from saved into tok,
+// leaving the lexer at lex (or the lex error, if failed), would come out the
+// same given more input. Only a token that runs into the end of the buffer
+// might not be done yet: identifiers, numbers, dates and comments could go
+// on, and more quotes could make "" or '' the start of a multi-line string,
+// or be part of a multi-line string's closing quotes. Newlines, punctuation
+// and other strings are complete. Errors are only final once a newline
+// shows they're not just truncation, except in multi-line strings which may
+// legitimately go on.
+static bool
+toml2_stream_complete(
+	toml2_lex_t *saved,
+	toml2_lex_t *lex,
+	toml2_token_t *tok,
+	bool failed
+) {
+	const char *start = saved->buf;
+	size_t left = saved->buf_left;
+
+	// Skip the whitespace the lexer would have.
+	while (0 < left && (' ' == *start || '\t' == *start || '\r' == *start)) {
+		start += 1;
+		left -= 1;
+	}
+
+	bool tquote = 3 <= left &&
+		('"' == start[0] || '\'' == start[0]) &&
+		start[0] == start[1] &&
+		start[0] == start[2];
+
+	if (failed) {
+		return !tquote && NULL != memchr(start, '\n', left);
+	}
+	if (0 != lex->buf_left) {
+		return true;
+	}
+
+	switch (tok->type) {
+		case TOML2_TOKEN_NEWLINE:
+		case TOML2_TOKEN_EQUALS:
+		case TOML2_TOKEN_COMMA:
+		case TOML2_TOKEN_DOT:
+		case TOML2_TOKEN_BRACE_OPEN:
+		case TOML2_TOKEN_BRACE_CLOSE:
+		case TOML2_TOKEN_BRACKET_OPEN:
+		case TOML2_TOKEN_BRACKET_CLOSE:
+			return true;
+		case TOML2_TOKEN_STRING:
+			return !tquote && 2 != (size_t) (lex->buf - start);
+		default:
+			return false;
+	}
+}
+
+// toml2_stream_run lexes and parses as much of st->buf as it can. When
+// final is false, a token that could still be extended by more input is
+// left in the buffer for next time.
+static int
+toml2_stream_run(toml2_stream_t *st, bool final)
+{
+	toml2_lex_t *lex = &st->lex;
+	toml2_token_t tok;
+	int ret;
+
+	if (!final && st->buf_len < st->retry) {
+		return 0;
+	}
+
+	while (DONE != st->mode) {
+		toml2_lex_t saved = *lex;
+		int err = toml2_lex_token(lex, &tok);
+		bool failed = 0 != err;
+
+		if (!final && !failed && TOML2_TOKEN_EOF == tok.type) {
+			// Everything fed so far has been parsed.
+			*lex = saved;
+			return 0;
+		}
+		if (!final && !toml2_stream_complete(&saved, lex, &tok, failed)) {
+			// Wait for at least as many bytes again as the token has.
+			size_t held = saved.buf_left;
+			*lex = saved;
+			st->retry = st->buf_len + (0 == held ? 1 : held);
+			return 0;
+		}
+		if (failed) {
+			return err;
+		}
+		if (TOML2_TOKEN_COMMENT == tok.type) {
+			continue;
+		}
+
+		if (0 != (ret = toml2_parse_step(&st->parser, &tok, &st->mode))) {
+			return toml2_parse_locate(lex, &tok, ret);
+		}
+	}
+
+	return 0;
+}
+
+// toml2_stream_append adds data to the end of st->buf, first dropping
+// everything the lexer has already consumed.
+static int
+toml2_stream_append(toml2_stream_t *st, const char *data, size_t datalen)
+{
+	toml2_lex_t *lex = &st->lex;
+	size_t used = lex->buf - lex->buf_start;
+
+	// Let the lexer account for the consumed bytes' line numbers while they
+	// are still there to look at.
+	toml2_lex_rebase(lex, lex->buf, lex->buf_left);
+
+	if (0 != used) {
+		memmove(st->buf, st->buf + used, st->buf_len - used);
+		st->buf_len -= used;
+		st->valid -= used;
+		st->retry = st->retry > used ? st->retry - used : 0;
+	}
+
+	if (st->buf_len + datalen > st->buf_cap) {
+		size_t new_cap = 2 * st->buf_cap;
+		if (new_cap < st->buf_len + datalen) {
+			new_cap = st->buf_len + datalen;
+		}
+
+		void *new_data = realloc(st->buf, new_cap);
+		if (NULL == new_data) {
+			return TOML2_NO_MEMORY;
+		}
+
+		st->buf = new_data;
+		st->buf_cap = new_cap;
+	}
+
+	if (0 != datalen) {
+		memcpy(st->buf + st->buf_len, data, datalen);
+		st->buf_len += datalen;
+	}
+
+	// Only hand the lexer bytes that are known-good UTF-8, holding back a
+	// sequence that's been split across chunks.
+	size_t complete = st->buf_len;
+	for (size_t back = 1; back <= 3 && back <= st->buf_len; back += 1) {
+		uint8_t ch = (uint8_t) st->buf[st->buf_len - back];
+		if (0x80 == (ch & 0xC0)) {
+			continue;
+		}
+
+		size_t seq = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : ch >= 0xC0 ? 2 : 1;
+		if (seq > back) {
+			complete -= back;
+		}
+		break;
+	}
+
+	if (complete > st->valid) {
+		size_t len = complete - st->valid;
+		size_t ok = toml2_scan_utf8(st->buf + st->valid, len);
+		if (len != ok) {
+			toml2_lex_rebase(lex, st->buf, complete);
+			toml2_lex_position(lex, st->valid + ok, &lex->err.line, &lex->err.col);
+			lex->err.err = TOML2_INVALID_UTF8;
+			return TOML2_INVALID_UTF8;
+		}
+		st->valid = complete;
+	}
+
+	toml2_lex_rebase(lex, st->buf, st->valid);
+	return 0;
+}
+
+int
+toml2_parse_feed(toml2_t *doc, const char *data, size_t datalen)
+{
+	int ret;
+	toml2_root_t *root = toml2_root(doc);
+	if (NULL == root) {
+		return TOML2_NO_MEMORY;
+	}
+
+	toml2_stream_t *st = root->stream;
+	if (NULL == st) {
+		if (NULL == (st = calloc(1, sizeof(*st)))) {
+			return TOML2_NO_MEMORY;
+		}
+
+		root->stream = st;
+		root->err = (toml2_err_t) { 0 };
+		st->mode = START_LINE;
+		toml2_lex_init(&st->lex, NULL, 0);
+		toml2_parse_init(&st->parser, &st->lex, 0);
+
+		if (0 != (st->err = toml2_parse_begin(&st->parser, doc))) {
+			return st->err;
+		}
+	}
+	if (0 != st->err) {
+		return st->err;
+	}
+
+	if (0 == (ret = toml2_stream_append(st, data, datalen))) {
+		ret = toml2_stream_run(st, false);
+	}
+	if (0 != ret) {
+		toml2_parse_locate(&st->lex, NULL, ret);
+		root->err = st->lex.err;
+	}
+
+	return st->err = ret;
+}
+
+int
+toml2_parse_finish(toml2_t *doc)
+{
+	int ret = toml2_parse_feed(doc, NULL, 0);
+	if (NULL == doc->root || NULL == doc->root->stream) {
+		return ret;
+	}
+
+	toml2_stream_t *st = doc->root->stream;
+	if (0 != ret) {
+		goto cleanup;
+	}
+
+	if (st->valid != st->buf_len) {
+		// Input ended partway through a UTF-8 sequence.
+		toml2_lex_t *lex = &st->lex;
+		size_t used = lex->buf - st->buf;
+		toml2_lex_rebase(lex, lex->buf, st->buf_len - used);
+		toml2_lex_position(lex, st->valid - used, &lex->err.line, &lex->err.col);
+		lex->err.err = TOML2_INVALID_UTF8;
+		ret = TOML2_INVALID_UTF8;
+	}
+	if (0 == ret) {
+		ret = toml2_stream_run(st, true);
+	}
+	if (0 == ret && DONE != st->mode) {
+		ret = TOML2_PARSE_ERROR;
+	}
+	if (0 == ret) {
+		ret = toml2_parse_sort(&st->parser, doc);
+	}
+	if (0 != ret) {
+		toml2_parse_locate(&st->lex, NULL, ret);
+		doc->root->err = st->lex.err;
+	}
+
+	cleanup: {
+		doc->root->stream = NULL;
+		toml2_stream_free(st);
+		return ret;
+	}
+}
+
+toml2_root_t*
+toml2_root(toml2_t *doc)
+{
+	// Only tables have a root pointer, and a root is always a table.
+	doc->type = TOML2_TABLE;
+	if (NULL == doc->root) {
+		doc->root = calloc(1, sizeof(*doc->root));
+	}
+
+	return doc->root;
+}
+
+toml2_err_t
+toml2_last_error(toml2_t *doc)
+{
+	if (TOML2_TABLE != doc->type || NULL == doc->root) {
+		return (toml2_err_t) { 0 };
+	}
+
+	return doc->root->err;
+}
+
+static void
+toml2_root_free(toml2_root_t *root)
+{
+	if (NULL == root) {
+		return;
+	}
+
+	toml2_stream_free(root->stream);
+	free(root->sections.sections);
+	toml2_intern_free(&root->keys);
+	toml2_arena_free(&root->arena);
+	if (NULL != root->map) {
+		munmap(root->map, root->map_len);
+	}
+	free(root);
 }
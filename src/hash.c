@@ -0,0 +1,115 @@
+#include "toml2-hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+uint64_t
+toml2_hash_str(const char *str, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < len; i += 1) {
+		hash ^= (unsigned char) str[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+// toml2_hash_cap returns the number of slots needed to hold len children.
+static size_t
+toml2_hash_cap(size_t len)
+{
+	size_t cap = 8;
+	while (cap < 2 * len) {
+		cap *= 2;
+	}
+
+	return cap;
+}
+
+size_t
+toml2_hash_size(size_t len)
+{
+	return sizeof(toml2_hash_t) + toml2_hash_cap(len) * sizeof(toml2_hash_slot_t);
+}
+
+void
+toml2_hash_init(toml2_hash_t *h, size_t len)
+{
+	bzero(h, toml2_hash_size(len));
+	h->cap = toml2_hash_cap(len);
+}
+
+toml2_hash_slot_t*
+toml2_hash_lookup(toml2_hash_t *h, const char *name, size_t len, uint64_t hash)
+{
+	size_t mask = h->cap - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		toml2_hash_slot_t *slot = &h->slots[i];
+		if (NULL == slot->child) {
+			return slot;
+		}
+		if (
+			hash == slot->hash &&
+			len == slot->len &&
+			0 == memcmp(name, slot->child->name, len)
+		) {
+			return slot;
+		}
+	}
+}
+
+int
+toml2_hash_reserve(toml2_hash_t **h, toml2_arena_t *arena)
+{
+	toml2_hash_t *old = *h;
+	size_t len = NULL == old ? 0 : old->len;
+	if (NULL != old && 2 * (len + 1) <= old->cap) {
+		return 0;
+	}
+
+	// Doubling the number of children to make room for keeps the slots
+	// at most half full.
+	size_t new_len = 0 == len ? 1 : 2 * len;
+	size_t size = toml2_hash_size(new_len);
+	toml2_hash_t *grown = NULL != arena
+		? toml2_arena_alloc(arena, size)
+		: malloc(size);
+	if (NULL == grown) {
+		return 1;
+	}
+
+	toml2_hash_init(grown, new_len);
+	for (size_t i = 0; NULL != old && i < old->cap; i += 1) {
+		toml2_hash_slot_t *slot = &old->slots[i];
+		if (NULL != slot->child) {
+			*toml2_hash_lookup(grown, slot->child->name, slot->len, slot->hash) = *slot;
+		}
+	}
+	grown->len = len;
+
+	if (NULL == arena) {
+		free(old);
+	}
+
+	*h = grown;
+	return 0;
+}
+
+toml2_t*
+toml2_hash_find(toml2_hash_t *h, const char *name, size_t len)
+{
+	return toml2_hash_lookup(h, name, len, toml2_hash_str(name, len))->child;
+}
+
+void
+toml2_hash_add(toml2_hash_t *h, toml2_t *child)
+{
+	uint64_t hash = toml2_hash_str(child->name, child->name_len);
+	toml2_hash_slot_t *slot = toml2_hash_lookup(h, child->name, child->name_len, hash);
+
+	slot->hash = hash;
+	slot->len = child->name_len;
+	slot->child = child;
+	h->len += 1;
+}
@@ -0,0 +1,214 @@
+#include "toml2.h"
+#include "toml2-index.h"
+#include "toml2-scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// The indexer is a small state machine stepped once per interesting byte
+// rather than once per byte: toml2_scan_marks finds the candidates in each
+// block and only the bits that matter in the current state are visited.
+typedef enum {
+	TOML2_INDEX_OUTSIDE,
+	TOML2_INDEX_COMMENT,
+	TOML2_INDEX_BASIC,
+	TOML2_INDEX_LITERAL,
+	TOML2_INDEX_ML_BASIC,
+	TOML2_INDEX_ML_LITERAL,
+}
+toml2_index_state_t;
+
+static int
+toml2_index_push(toml2_index_t *idx, size_t pos)
+{
+	if (idx->len == idx->cap) {
+		size_t new_cap = 0 == idx->cap ? 256 : idx->cap * 2;
+
+		void *new_pos = realloc(idx->pos, new_cap * sizeof(*idx->pos));
+		if (NULL == new_pos) {
+			return TOML2_NO_MEMORY;
+		}
+		idx->pos = new_pos;
+
+		void *new_clean = realloc(idx->clean, new_cap / 8);
+		if (NULL == new_clean) {
+			return TOML2_NO_MEMORY;
+		}
+		idx->clean = new_clean;
+		bzero(idx->clean + idx->cap / 64, (new_cap - idx->cap) / 8);
+
+		idx->cap = new_cap;
+	}
+
+	idx->pos[idx->len] = (uint32_t) pos;
+	idx->len += 1;
+	return 0;
+}
+
+// toml2_index_peek returns buf[pos], or 0 past the end like the lexer does.
+static inline char
+toml2_index_peek(const char *buf, size_t len, size_t pos)
+{
+	return pos < len ? buf[pos] : 0;
+}
+
+int
+toml2_index_build(toml2_index_t *idx, const char *buf, size_t len)
+{
+	bzero(idx, sizeof(*idx));
+
+	if (len > UINT32_MAX) {
+		return TOML2_INTERNAL_ERROR;
+	}
+
+	toml2_index_state_t state = TOML2_INDEX_OUTSIDE;
+
+	// open is the entry of the string currently being scanned, clean
+	// whether it's still clean; next is the first offset not yet consumed.
+	size_t open = 0, next = 0;
+	bool clean = false;
+
+	for (size_t block = 0; block < len; block += 64) {
+		toml2_scan_marks_t m;
+
+		if (block + 64 <= len) {
+			toml2_scan_marks(buf + block, &m);
+		}
+		else {
+			// The last partial block goes through a padded copy, with the
+			// padding masked off so it doesn't look like NULs.
+			char tail[64] = { 0 };
+			memcpy(tail, buf + block, len - block);
+			toml2_scan_marks(tail, &m);
+			m.nul &= ((uint64_t) 1 << (len - block)) - 1;
+		}
+
+		for (;;) {
+			uint64_t bits;
+			switch (state) {
+				case TOML2_INDEX_OUTSIDE:
+					bits = m.punct | m.dquote | m.squote | m.newline | m.hash;
+					break;
+				case TOML2_INDEX_COMMENT:
+					bits = m.newline;
+					break;
+				case TOML2_INDEX_BASIC:
+					bits = m.dquote | m.backslash | m.newline | m.nul;
+					break;
+				case TOML2_INDEX_LITERAL:
+					bits = m.squote | m.newline | m.nul;
+					break;
+				case TOML2_INDEX_ML_BASIC:
+					bits = m.dquote | m.backslash | m.nul;
+					break;
+				default:
+					bits = m.squote | m.nul;
+					break;
+			}
+
+			if (next > block) {
+				bits &= next - block >= 64
+					? 0
+					: ~(((uint64_t) 1 << (next - block)) - 1);
+			}
+			if (0 == bits) {
+				break;
+			}
+
+			size_t bit = __builtin_ctzll(bits);
+			size_t pos = block + bit;
+			char ch = buf[pos];
+			next = pos + 1;
+
+			if (TOML2_INDEX_OUTSIDE == state) {
+				if (0 != toml2_index_push(idx, pos)) {
+					return TOML2_NO_MEMORY;
+				}
+
+				if ('#' == ch) {
+					state = TOML2_INDEX_COMMENT;
+				}
+				else if ('"' == ch || '\'' == ch) {
+					bool basic = '"' == ch;
+					bool second = ch == toml2_index_peek(buf, len, pos + 1);
+
+					if (second && ch == toml2_index_peek(buf, len, pos + 2)) {
+						state = basic
+							? TOML2_INDEX_ML_BASIC
+							: TOML2_INDEX_ML_LITERAL;
+						next = pos + 3;
+					}
+					else if (second) {
+						// An empty string; the second quote isn't an opener.
+						next = pos + 2;
+					}
+					else {
+						state = basic ? TOML2_INDEX_BASIC : TOML2_INDEX_LITERAL;
+						open = idx->len - 1;
+						clean = true;
+					}
+				}
+				continue;
+			}
+
+			switch (state) {
+				case TOML2_INDEX_COMMENT:
+					// The newline ends the comment but is a token of its
+					// own, so it gets looked at again from outside.
+					state = TOML2_INDEX_OUTSIDE;
+					next = pos;
+					break;
+
+				case TOML2_INDEX_BASIC:
+				case TOML2_INDEX_LITERAL:
+					if ('\\' == ch) {
+						clean = false;
+						next = pos + 2;
+						break;
+					}
+
+					state = TOML2_INDEX_OUTSIDE;
+					if ('"' != ch && '\'' != ch) {
+						// An unterminated string, which the lexer will
+						// report; carry on as though it had ended here.
+						next = pos;
+						break;
+					}
+
+					if (clean) {
+						if (0 != toml2_index_push(idx, pos)) {
+							return TOML2_NO_MEMORY;
+						}
+						idx->clean[open / 64] |= (uint64_t) 1 << (open % 64);
+					}
+					break;
+
+				default:
+					if ('\\' == ch) {
+						next = pos + 2;
+					}
+					else if (0 == ch) {
+						state = TOML2_INDEX_OUTSIDE;
+					}
+					else if (
+						ch == toml2_index_peek(buf, len, pos + 1) &&
+						ch == toml2_index_peek(buf, len, pos + 2)
+					) {
+						state = TOML2_INDEX_OUTSIDE;
+						next = pos + 3;
+					}
+					break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void
+toml2_index_free(toml2_index_t *idx)
+{
+	free(idx->pos);
+	free(idx->clean);
+	bzero(idx, sizeof(*idx));
+}
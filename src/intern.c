@@ -0,0 +1,114 @@
+#include "toml2-intern.h"
+#include "toml2-hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// toml2_intern_lookup returns the slot holding str, or the empty slot it
+// would go in.
+static toml2_intern_slot_t*
+toml2_intern_lookup(
+	toml2_intern_t *t,
+	const char *str,
+	size_t len,
+	uint64_t hash
+) {
+	size_t mask = t->cap - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		toml2_intern_slot_t *slot = &t->slots[i];
+		if (NULL == slot->str) {
+			return slot;
+		}
+		if (
+			hash == slot->hash &&
+			len == slot->len &&
+			0 == memcmp(str, slot->str, len)
+		) {
+			return slot;
+		}
+	}
+}
+
+// toml2_intern_grow doubles the size of the table, which is kept at most
+// half full.
+static int
+toml2_intern_grow(toml2_intern_t *t)
+{
+	toml2_intern_t grown = *t;
+	grown.cap = 0 == t->cap ? 64 : 2 * t->cap;
+	grown.slots = calloc(grown.cap, sizeof(toml2_intern_slot_t));
+	if (NULL == grown.slots) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < t->cap; i += 1) {
+		toml2_intern_slot_t *slot = &t->slots[i];
+		if (NULL != slot->str) {
+			*toml2_intern_lookup(&grown, slot->str, slot->len, slot->hash) = *slot;
+		}
+	}
+
+	free(t->slots);
+	*t = grown;
+	return 0;
+}
+
+const char*
+toml2_intern(toml2_intern_t *t, const char *str, size_t len)
+{
+	if (2 * (t->len + 1) > t->cap && 0 != toml2_intern_grow(t)) {
+		return NULL;
+	}
+
+	uint64_t hash = toml2_hash_str(str, len);
+	toml2_intern_slot_t *slot = toml2_intern_lookup(t, str, len, hash);
+	if (NULL != slot->str) {
+		return slot->str;
+	}
+
+	char *copy = toml2_arena_alloc_str(&t->strs, len + 1);
+	if (NULL == copy) {
+		return NULL;
+	}
+	memcpy(copy, str, len);
+	copy[len] = 0;
+
+	slot->str = copy;
+	slot->len = len;
+	slot->hash = hash;
+	t->len += 1;
+	t->strs_len += len + 1;
+	return copy;
+}
+
+const char*
+toml2_intern_find(toml2_intern_t *t, const char *str, size_t len)
+{
+	if (0 == t->cap) {
+		return NULL;
+	}
+
+	uint64_t hash = toml2_hash_str(str, len);
+	return toml2_intern_lookup(t, str, len, hash)->str;
+}
+
+void
+toml2_intern_move(toml2_intern_t *t, char *dst)
+{
+	for (size_t i = 0; i < t->cap; i += 1) {
+		toml2_intern_slot_t *slot = &t->slots[i];
+		if (NULL != slot->str) {
+			memcpy(dst, slot->str, slot->len + 1);
+			slot->str = dst;
+			dst += slot->len + 1;
+		}
+	}
+}
+
+void
+toml2_intern_free(toml2_intern_t *t)
+{
+	free(t->slots);
+	toml2_arena_free(&t->strs);
+	bzero(t, sizeof(*t));
+}
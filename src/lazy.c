@@ -0,0 +1,73 @@
+#include "toml2.h"
+#include "toml2-lazy.h"
+#include "toml2-lexer.h"
+#include <sched.h>
+#include <stdlib.h>
+
+// toml2_lazy_decode_raw replaces the source text in node with its value.
+// Only the thread that moved node to TOML2_LAZY_BUSY may call this.
+static int
+toml2_lazy_decode_raw(toml2_t *node)
+{
+	if (TOML2_FLOAT == node->type) {
+		double val;
+		int ret = toml2_lex_decode_double(node->raw, node->raw_len, &val);
+		if (0 != ret) {
+			return ret;
+		}
+
+		node->fval = val;
+		return 0;
+	}
+
+	char *buf = malloc(node->raw_len + 1);
+	if (NULL == buf) {
+		return TOML2_NO_MEMORY;
+	}
+
+	node->sval_len = toml2_lex_decode_str(node->raw, node->raw_len, buf);
+	node->sval = buf;
+	node->sval_borrowed = false;
+	return 0;
+}
+
+int
+toml2_lazy_decode(toml2_t *node)
+{
+	char state = __atomic_load_n(&node->lazy, __ATOMIC_ACQUIRE);
+
+	while (TOML2_LAZY_DONE != state) {
+		if (TOML2_LAZY_BUSY == state) {
+			// Decoding is quick, so just wait for whichever thread is
+			// doing it.
+			sched_yield();
+			state = __atomic_load_n(&node->lazy, __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		if (
+			!__atomic_compare_exchange_n(
+				&node->lazy,
+				&state,
+				TOML2_LAZY_BUSY,
+				false,
+				__ATOMIC_ACQUIRE,
+				__ATOMIC_ACQUIRE
+			)
+		) {
+			continue;
+		}
+
+		// The value is written over the source text, so it has to be
+		// complete before anyone else can see TOML2_LAZY_DONE.
+		int ret = toml2_lazy_decode_raw(node);
+		__atomic_store_n(
+			&node->lazy,
+			0 == ret ? TOML2_LAZY_DONE : TOML2_LAZY_RAW,
+			__ATOMIC_RELEASE
+		);
+		return ret;
+	}
+
+	return 0;
+}
@@ -1,32 +1,143 @@
 #include "toml2.h"
 #include "toml2-lexer.h"
+#include "toml2-scan.h"
+#include "toml2-float.h"
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
-#include <math.h>
-
-typedef int (*toml2_lex_fn)(toml2_lex_t*, toml2_token_t*, uint32_t); 
 
 typedef enum {
 	TOML2_QUOTE_SINGLE = 1,
 }
 toml2_lex_flags_t;
 
-static int
-toml2_check_uerr(toml2_lex_t *lex, UErrorCode uerr)
+// Every byte value has a class in toml2_lex_class. The low nibble is the
+// state toml2_lex_token dispatches on when a token starts with that byte;
+// the high bits say which multi-byte tokens the byte may appear within.
+// Anything not listed (including all non-ASCII bytes) is 0: it starts and
+// continues an identifier.
+enum {
+	TOML2_CH_ID = 0,
+	TOML2_CH_NEWLINE,
+	TOML2_CH_BRACKET_OPEN,
+	TOML2_CH_BRACKET_CLOSE,
+	TOML2_CH_BRACE_OPEN,
+	TOML2_CH_BRACE_CLOSE,
+	TOML2_CH_EQUALS,
+	TOML2_CH_COMMA,
+	TOML2_CH_DOT,
+	TOML2_CH_COMMENT,
+	TOML2_CH_SQUOTE,
+	TOML2_CH_DQUOTE,
+	TOML2_CH_VALUE,
+	TOML2_CH_START = 0x0F,
+
+	// TOML2_CH_ID_END bytes terminate an identifier.
+	TOML2_CH_ID_END = 0x10,
+	// TOML2_CH_IN_VALUE bytes may appear in an int, double or date.
+	TOML2_CH_IN_VALUE = 0x20,
+	// TOML2_CH_DATE bytes only appear in dates.
+	TOML2_CH_DATE = 0x40,
+	// TOML2_CH_DOUBLE bytes appear in doubles (and possibly dates).
+	TOML2_CH_DOUBLE = 0x80,
+};
+
+#define TOML2_CH_DIGIT (TOML2_CH_VALUE | TOML2_CH_IN_VALUE)
+
+static const uint8_t toml2_lex_class[256] = {
+	[0]    = TOML2_CH_ID_END,
+	[' ']  = TOML2_CH_ID_END,
+	['\t'] = TOML2_CH_ID_END,
+	['\r'] = TOML2_CH_ID_END,
+	['\n'] = TOML2_CH_NEWLINE | TOML2_CH_ID_END,
+	['[']  = TOML2_CH_BRACKET_OPEN | TOML2_CH_ID_END,
+	[']']  = TOML2_CH_BRACKET_CLOSE | TOML2_CH_ID_END,
+	['{']  = TOML2_CH_BRACE_OPEN | TOML2_CH_ID_END,
+	['}']  = TOML2_CH_BRACE_CLOSE | TOML2_CH_ID_END,
+	['=']  = TOML2_CH_EQUALS | TOML2_CH_ID_END,
+	[',']  = TOML2_CH_COMMA | TOML2_CH_ID_END,
+	['.']  = TOML2_CH_DOT | TOML2_CH_ID_END
+		| TOML2_CH_IN_VALUE | TOML2_CH_DOUBLE,
+	[':']  = TOML2_CH_ID_END | TOML2_CH_IN_VALUE | TOML2_CH_DATE,
+	['#']  = TOML2_CH_COMMENT | TOML2_CH_ID_END,
+	['\''] = TOML2_CH_SQUOTE,
+	['"']  = TOML2_CH_DQUOTE,
+	['+']  = TOML2_CH_VALUE | TOML2_CH_IN_VALUE,
+	['-']  = TOML2_CH_VALUE | TOML2_CH_IN_VALUE,
+	['_']  = TOML2_CH_IN_VALUE,
+	['0']  = TOML2_CH_DIGIT, ['1'] = TOML2_CH_DIGIT, ['2'] = TOML2_CH_DIGIT,
+	['3']  = TOML2_CH_DIGIT, ['4'] = TOML2_CH_DIGIT, ['5'] = TOML2_CH_DIGIT,
+	['6']  = TOML2_CH_DIGIT, ['7'] = TOML2_CH_DIGIT, ['8'] = TOML2_CH_DIGIT,
+	['9']  = TOML2_CH_DIGIT,
+	['e']  = TOML2_CH_IN_VALUE | TOML2_CH_DOUBLE,
+	['E']  = TOML2_CH_IN_VALUE | TOML2_CH_DOUBLE,
+	['t']  = TOML2_CH_IN_VALUE | TOML2_CH_DATE,
+	['T']  = TOML2_CH_IN_VALUE | TOML2_CH_DATE,
+	['z']  = TOML2_CH_IN_VALUE | TOML2_CH_DATE,
+	['Z']  = TOML2_CH_IN_VALUE | TOML2_CH_DATE,
+};
+
+static inline uint8_t
+toml2_lex_classify(char ch)
 {
-	if (0 == uerr) {
-		return 0;
+	return toml2_lex_class[(uint8_t) ch];
+}
+
+static size_t
+toml2_lex_pos(const toml2_lex_t *lex)
+{
+	return lex->buf - lex->buf_start;
+}
+
+// toml2_lex_locate finds the line/col of offset in lex->buf_start, by binary
+// search if the newline index has been built or by counting otherwise. The
+// lexer itself only ever tracks byte offsets; this is for errors and callers
+// that want to show a position.
+static void
+toml2_lex_locate(
+	const toml2_lex_t *lex,
+	size_t offset,
+	size_t *line,
+	size_t *col
+) {
+	size_t lines = 0, line_start = 0;
+
+	if (offset > lex->buf_len) {
+		offset = lex->buf_len;
 	}
 
-	// Don't care about null termination; all this code uses lengths.
-	if (U_STRING_NOT_TERMINATED_WARNING == uerr) {
-		return 0;
+	if (lex->nl_ok) {
+		size_t lo = 0, hi = lex->nl_len;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (lex->nl[mid] < offset) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+
+		lines = lo;
+		line_start = 0 == lo ? 0 : lex->nl[lo - 1] + 1;
 	}
+	else {
+		for (;;) {
+			size_t nl = toml2_scan_newline(
+				lex->buf_start + line_start,
+				offset - line_start
+			);
+			if (line_start + nl == offset) {
+				break;
+			}
 
-	lex->err.err = TOML2_ICUUC_ERROR;
-	lex->err.code = uerr;
-	return 1;
+			lines += 1;
+			line_start += nl + 1;
+		}
+	}
+
+	*line = lex->line_base + lines;
+	*col = (0 == lines ? lex->col_base : 1) + offset - line_start;
 }
 
 int
@@ -34,69 +145,95 @@ toml2_lex_init(toml2_lex_t *lex, const char *data, size_t datalen)
 {
 	bzero(lex, sizeof(*lex));
 
-	int32_t srclen = (int32_t) datalen;
-	int32_t dstlen = 0;
-	int ret;
+	lex->buf_start = data;
+	lex->buf = data;
+	lex->buf_len = datalen;
+	lex->buf_left = datalen;
 
-	UErrorCode uerr = 0;
-
-	u_strFromUTF8(NULL, 0, &dstlen, data, srclen, &uerr);
-	// This is annoying, but U_BUFFER_OVERFLOW_ERROR is unconditionally
-	// returned if we're preflighting. Ignore that, obviously we're overflowing
-	// an empty buffer.
-	if (U_BUFFER_OVERFLOW_ERROR != uerr) {
-		if (0 != (ret = toml2_check_uerr(lex, uerr))) {
-			return ret;
-		}
+	// One-index the line/columns.
+	lex->line_base = 1;
+	lex->col_base = 1;
+
+	// The lexer works on the UTF-8 bytes directly, so they're validated once
+	// here and everything else can assume well-formed input.
+	size_t bad = toml2_scan_utf8(data, datalen);
+	if (bad != datalen) {
+		lex->err.err = TOML2_INVALID_UTF8;
+		toml2_lex_locate(lex, bad, &lex->err.line, &lex->err.col);
+		return lex->err.err;
 	}
 
-	lex->buf_start = calloc(dstlen, sizeof(UChar));
-	lex->buf_len = (size_t) dstlen;
-	lex->buf_left = lex->buf_len;
+	return 0;
+}
+
+void
+toml2_lex_rebase(toml2_lex_t *lex, const char *data, size_t datalen)
+{
+	toml2_lex_locate(lex, toml2_lex_pos(lex), &lex->line_base, &lex->col_base);
+
+	free(lex->nl);
+	lex->nl = NULL;
+	lex->nl_len = 0;
+	lex->nl_ok = false;
+
+	lex->buf_start = data;
+	lex->buf = data;
+	lex->buf_len = datalen;
+	lex->buf_left = datalen;
+}
+
+void
+toml2_lex_position(toml2_lex_t *lex, size_t offset, size_t *line, size_t *col)
+{
+	if (!lex->nl_ok) {
+		size_t cap = 0;
+		size_t pos = 0;
+
+		for (;;) {
+			pos += toml2_scan_newline(lex->buf_start + pos, lex->buf_len - pos);
+			if (pos == lex->buf_len) {
+				break;
+			}
+
+			if (lex->nl_len == cap) {
+				size_t new_cap = 0 == cap ? 64 : 2 * cap;
+				void *new_nl = realloc(lex->nl, new_cap * sizeof(*lex->nl));
+				if (NULL == new_nl) {
+					// Without the index, just count the slow way.
+					free(lex->nl);
+					lex->nl = NULL;
+					lex->nl_len = 0;
+					break;
+				}
+
+				lex->nl = new_nl;
+				cap = new_cap;
+			}
 
-	// Manually clear the error since it's not done for us (and will be
-	// set automatically unless datalen==0).
-	uerr = 0;
+			lex->nl[lex->nl_len] = pos;
+			lex->nl_len += 1;
+			pos += 1;
+		}
 
-	lex->buf = u_strFromUTF8(
-		lex->buf_start,
-		dstlen,
-		NULL,
-		data,
-		srclen,
-		&uerr
-	);
-	if (0 != (ret = toml2_check_uerr(lex, uerr))) {
-		return ret;
+		lex->nl_ok = pos == lex->buf_len;
 	}
-	
-	// One-index the line/columns.
-	lex->line = 1;
-	lex->col = 1;
-	
-	return 0;
+
+	toml2_lex_locate(lex, offset, line, col);
 }
 
 void
 toml2_lex_free(toml2_lex_t *lex)
 {
-	free(lex->buf_start);
+	free(lex->nl);
+
 	bzero(lex, sizeof(toml2_lex_t));
 }
 
 static void
-toml2_lex_advance(toml2_lex_t *lex, bool newline)
+toml2_lex_advance(toml2_lex_t *lex)
 {
 	lex->buf_left -= 1;
 	lex->buf += 1;
-
-	if (newline) {
-		lex->col = 1;
-		lex->line += 1;
-
-	} else {
-		lex->col += 1;
-	}
 }
 
 static void
@@ -108,10 +245,9 @@ toml2_lex_advance_n(toml2_lex_t *lex, size_t count)
 
 	lex->buf_left -= count;
 	lex->buf += count;
-	lex->col += count;
 }
 
-static UChar
+static char
 toml2_lex_peek(toml2_lex_t *lex, size_t off)
 {
 	if (off >= lex->buf_left) {
@@ -121,11 +257,6 @@ toml2_lex_peek(toml2_lex_t *lex, size_t off)
 	return lex->buf[off];
 }
 
-static size_t
-toml2_lex_pos(toml2_lex_t *lex)
-{
-	return lex->buf - lex->buf_start;
-}
 
 static int
 toml2_lex_emit(
@@ -137,14 +268,13 @@ toml2_lex_emit(
 	tok->start = toml2_lex_pos(lex);
 	tok->end = tok->start + len;
 	tok->type = type;
-	tok->line = lex->line;
-	tok->col = lex->col;
+	tok->escaped = false;
 	lex->err.err = 0;
 	return 0;
 }
 
 static bool
-toml2_is_whitespace(UChar ch)
+toml2_is_whitespace(char ch)
 {
 	return ' ' == ch || '\r' == ch || '\t' == ch;
 }
@@ -152,36 +282,30 @@ toml2_is_whitespace(UChar ch)
 static void
 toml2_lex_eat_whitespace(toml2_lex_t *lex)
 {
-	while (lex->buf_left > 0) {
-		UChar p = lex->buf[0];
-
-		if (!toml2_is_whitespace(p)) {
-			break;
-		}
+	toml2_lex_advance_n(lex, toml2_scan_blank(lex->buf, lex->buf_left));
+}
 
-		toml2_lex_advance(lex, false);
-	}
+// toml2_lex_eat_newlines skips any blank lines following a newline so that a
+// run of them is emitted as a single TOML2_TOKEN_NEWLINE. The grammar treats
+// consecutive newlines the same as one anywhere it accepts them.
+static void
+toml2_lex_eat_newlines(toml2_lex_t *lex)
+{
+	toml2_lex_advance_n(lex, toml2_scan_space(lex->buf, lex->buf_left));
 }
 
 static int
 toml2_lex_comment(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 {
-	do {
-		UChar p = lex->buf[0];
-		if (p == '\n') {
-			// NOTE: Leave the newline in the buf so that a newline token gets
-			// generated next.
-			break;
-		}
-		toml2_lex_advance(lex, p == '\n');
-	}
-	while (lex->buf_left > 0);
+	// NOTE: Leave the newline in the buf so that a newline token gets
+	// generated next.
+	toml2_lex_advance_n(lex, toml2_scan_newline(lex->buf, lex->buf_left));
 
 	return toml2_lex_emit(lex, tok, 0, TOML2_TOKEN_COMMENT);
 }
 
-static UChar
-toml2_lex_unescape_table(toml2_lex_t *lex, UChar ch)
+static char
+toml2_lex_unescape_table(char ch)
 {
 	switch (ch) {
 		case 'b': return '\b';
@@ -191,54 +315,35 @@ toml2_lex_unescape_table(toml2_lex_t *lex, UChar ch)
 		case 'r': return '\r';
 		case '\\': return '\\';
 		case '"': return '"';
-		// u/U handled in toml2_lex_unescape.
+		// u/U handled in toml2_lex_escape.
 		default: return 0;
 	}
 }
 
 static int
-toml2_lex_unescape_code(toml2_lex_t *lex, size_t pos, size_t len, UChar **wpos)
+toml2_lex_hex(char ch)
 {
-	UChar32 v = 0;
-
-	for (size_t i = 0; i < len; i += 1) {
-		v <<= 4;
-
-		UChar ch = toml2_lex_peek(lex, pos + i);
-		if ('a' <= ch && 'f' >= ch) {
-			v += (ch - 'a') + 10;
-		}
-		else if ('A' <= ch && 'F' >= ch) {
-			v += (ch - 'A') + 10;
-		}
-		else if ('0' <= ch && '9' >= ch) {
-			v += ch - '0';
-		}
-		else {
-			return 1;
-		}
+	if ('a' <= ch && 'f' >= ch) {
+		return (ch - 'a') + 10;
 	}
-
-	int32_t dstout = 2;
-	UErrorCode uerr = 0;
-
-	// This is cheating but I don't care.
-	u_strFromUTF32(*wpos, 2, &dstout, &v, 1, &uerr);
-	if (uerr && uerr != U_STRING_NOT_TERMINATED_WARNING) {
-		return 1;
+	if ('A' <= ch && 'F' >= ch) {
+		return (ch - 'A') + 10;
 	}
-
-	*wpos += dstout;
-	return 0;
+	if ('0' <= ch && '9' >= ch) {
+		return ch - '0';
+	}
+	return -1;
 }
 
-static int
-toml2_lex_unescape(toml2_lex_t *lex, size_t pos, size_t len, UChar **wpos) {
-	UChar ch = toml2_lex_peek(lex, pos);
-	UChar rep = toml2_lex_unescape_table(lex, ch);
-	if (0 != rep) {
-		**wpos = rep;
-		*wpos += 1;
+// toml2_lex_escape validates the escape sequence starting at pos (the
+// character after the backslash) and returns the number of characters that
+// make it up, or 0 if it's not a valid escape. Nothing is decoded here; that
+// happens when the token is extracted.
+static size_t
+toml2_lex_escape(toml2_lex_t *lex, size_t pos)
+{
+	char ch = toml2_lex_peek(lex, pos);
+	if (0 != toml2_lex_unescape_table(ch)) {
 		return 1;
 	}
 
@@ -246,65 +351,101 @@ toml2_lex_unescape(toml2_lex_t *lex, size_t pos, size_t len, UChar **wpos) {
 		return 0;
 	}
 
-	// So, our underlying buffer is UTF-16; the \u escape is a single
-	// UTF-16 scalar and \U is a UTF-32 scalar. I'm *pretty* sure that in the
-	// latter case we can just treat it as two separate UTF-16 code points.
-	// That might be totally wrong though :sadface:.
+	// \u is four hex digits and \U is eight; either way the result must be
+	// a unicode scalar value (so no surrogates).
+	size_t len = 'u' == ch ? 4 : 8;
+	uint32_t v = 0;
+
+	for (size_t i = 0; i < len; i += 1) {
+		int digit = toml2_lex_hex(toml2_lex_peek(lex, pos + 1 + i));
+		if (0 > digit) {
+			return 0;
+		}
 
-	int ret;
-	size_t inlen = 'u' == ch ? 4 : 8;
+		v = (v << 4) | (uint32_t) digit;
+	}
 
-	if (inlen + 1 > len) {
+	if ((0xD800 <= v && 0xDFFF >= v) || 0x10FFFF < v) {
 		return 0;
 	}
-	if (0 != (ret = toml2_lex_unescape_code(lex, pos + 1, inlen, wpos))) {
-		return 0;
+
+	return len + 1;
+}
+
+// toml2_utf8_encode writes the UTF-8 encoding of the scalar value v to out,
+// returning the number of bytes written (at most 4).
+static size_t
+toml2_utf8_encode(uint32_t v, char *out)
+{
+	if (v < 0x80) {
+		out[0] = (char) v;
+		return 1;
+	}
+	if (v < 0x800) {
+		out[0] = (char) (0xC0 | (v >> 6));
+		out[1] = (char) (0x80 | (v & 0x3F));
+		return 2;
+	}
+	if (v < 0x10000) {
+		out[0] = (char) (0xE0 | (v >> 12));
+		out[1] = (char) (0x80 | ((v >> 6) & 0x3F));
+		out[2] = (char) (0x80 | (v & 0x3F));
+		return 3;
 	}
 
-	return inlen + 1;
+	out[0] = (char) (0xF0 | (v >> 18));
+	out[1] = (char) (0x80 | ((v >> 12) & 0x3F));
+	out[2] = (char) (0x80 | ((v >> 6) & 0x3F));
+	out[3] = (char) (0x80 | (v & 0x3F));
+	return 4;
 }
 
-// toml2_lex_demangle does an in-place modification from pos:pos+*orig_len and 
-// replaces any escape codes and such with their corresponding byte strings.
-// The underlying position is unchanged, but the new length is written out
-// to orig_len.
-static int
-toml2_lex_demangle(
-	toml2_lex_t *lex,
-	size_t *orig_len
-) {
-	UChar *wpos = lex->buf;
+// toml2_lex_unescape decodes len bytes of an (already validated) basic string
+// body at src into dst, returning the decoded length. The decoded form is
+// never longer than the source, so dst needs at most len bytes.
+static size_t
+toml2_lex_unescape(const char *src, size_t len, char *dst)
+{
+	size_t w = 0;
 
-	for (size_t i = 0; i < *orig_len; i += 1) {
-		UChar ch = toml2_lex_peek(lex, i);
-		if (0 == ch) {
-			// This should be impossible.
-			lex->err.err = TOML2_INTERNAL_ERROR;
-			return 1;
+	for (size_t i = 0; i < len; i += 1) {
+		char ch = src[i];
+		if ('\\' != ch) {
+			dst[w++] = ch;
+			continue;
 		}
 
-		if ('\\' == ch) {
-			size_t off = toml2_lex_unescape(
-				lex,
-				i + 1,
-				*orig_len - i - 1,
-				&wpos
-			);
-			if (0 == off) {
-				lex->err.err = TOML2_INVALID_ESCAPE;
-				return 1;
+		i += 1;
+		ch = src[i];
+
+		// With """, \\n trims whitespace until the next char isn't whitespace.
+		if ('\n' == ch) {
+			while (
+				i + 1 < len
+				&& (toml2_is_whitespace(src[i + 1]) || '\n' == src[i + 1])
+			) {
+				i += 1;
+			}
+			continue;
+		}
+
+		if ('u' == ch || 'U' == ch) {
+			size_t n = 'u' == ch ? 4 : 8;
+			uint32_t v = 0;
+
+			for (size_t j = 0; j < n; j += 1) {
+				v = (v << 4) | (uint32_t) toml2_lex_hex(src[i + 1 + j]);
 			}
 
-			i += off;
+			w += toml2_utf8_encode(v, dst + w);
+			i += n;
 			continue;
 		}
 
-		*wpos = ch;
-		wpos += 1;
+		dst[w++] = toml2_lex_unescape_table(ch);
 	}
 
-	*orig_len = wpos - lex->buf;
-	return 0;
+	return w;
 }
 
 static int
@@ -313,59 +454,50 @@ toml2_lex_quote(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 	// Consume until we hit EOF (error), NL (error) or a close quote.
 	// When !TOML2_QUOTE_SINGLE, we need to be aware of escaped quotes.
 	const char q = (flags & TOML2_QUOTE_SINGLE) ? '\'' : '"';
+	const toml2_errcode_t unclosed = q == '"'
+		? TOML2_UNCLOSED_DQUOTE
+		: TOML2_UNCLOSED_SQUOTE;
+	const char esc = q == '"' ? '\\' : q;
 
 	size_t len = 0;
-	bool escape = false;
+	bool escaped = false;
 
 	// Skip the leading quote.
-	toml2_lex_advance(lex, false);
-
-	for (;; len += 1) {
-		UChar next = toml2_lex_peek(lex, len);
-		if (0 == next) {
-			lex->err.err = q == '"'
-				? TOML2_UNCLOSED_DQUOTE
-				: TOML2_UNCLOSED_SQUOTE;
-			return 1;
-		}
+	toml2_lex_advance(lex);
 
-		if (q == '"' && next == '\\') {
-			escape = !escape;
-			continue;
-		}
+	for (;;) {
+		// Jump straight to the next quote/escape/newline; everything in
+		// between is string content that needs no further attention.
+		len += toml2_scan_string(lex->buf + len, lex->buf_left - len, q, esc);
 
-		if ('\n' == next) {
-			lex->err.err = q == '"'
-				? TOML2_UNCLOSED_DQUOTE
-				: TOML2_UNCLOSED_SQUOTE;
+		char next = toml2_lex_peek(lex, len);
+		if (0 == next || '\n' == next) {
+			lex->err.err = unclosed;
 			return 1;
 		}
 
 		if (q == next) {
-			if (q == '"' && escape) {
-				escape = false;
-				continue;
-			}
 			break;
 		}
 
-		escape = false;
-	};
-
-	if (q == '"') {
-		size_t new_len = len;
+		// Only basic strings stop on a backslash.
+		if (0 == toml2_lex_peek(lex, len + 1)) {
+			lex->err.err = unclosed;
+			return 1;
+		}
 
-		int ret = toml2_lex_demangle(lex, &new_len);
-		if (0 != ret) {
-			return ret;
+		size_t off = toml2_lex_escape(lex, len + 1);
+		if (0 == off) {
+			lex->err.err = TOML2_INVALID_ESCAPE;
+			return 1;
 		}
 
-		toml2_lex_emit(lex, tok, new_len, TOML2_TOKEN_STRING);
-	}
-	else {
-		toml2_lex_emit(lex, tok, len, TOML2_TOKEN_STRING);
+		escaped = true;
+		len += off + 1;
 	}
 
+	toml2_lex_emit(lex, tok, len, TOML2_TOKEN_STRING);
+	tok->escaped = escaped;
 	toml2_lex_advance_n(lex, len + 1);
 	return 0;
 }
@@ -376,19 +508,20 @@ toml2_lex_tquote(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 	toml2_lex_advance_n(lex, 3);
 
 	const char q = (flags & TOML2_QUOTE_SINGLE) ? '\'' : '"';
+	const toml2_errcode_t unclosed = q == '"'
+		? TOML2_UNCLOSED_TDQUOTE
+		: TOML2_UNCLOSED_TSQUOTE;
 	
 	// If the first character is a newline or a backspace+newline, trim off
 	// the leading whitespace.
-	UChar ch = toml2_lex_peek(lex, 0);
+	char ch = toml2_lex_peek(lex, 0);
 	if (0 == ch) {
-		lex->err.err = (q == '"')
-			? TOML2_UNCLOSED_TDQUOTE
-			: TOML2_UNCLOSED_TSQUOTE;
+		lex->err.err = unclosed;
 		return 1;
 	}
 	else if ('\n' == ch) {
 		while ('\n' == toml2_lex_peek(lex, 0)) {
-			toml2_lex_advance(lex, true);
+			toml2_lex_advance(lex);
 			toml2_lex_eat_whitespace(lex);
 		}
 	}
@@ -396,82 +529,74 @@ toml2_lex_tquote(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 		// XXX: The spec is a bit ambiguous; not sure if this requires triple
 		// double quotes or also works with triple singles. Just making it
 		// work with both now.
-		toml2_lex_advance(lex, false);
+		toml2_lex_advance(lex);
 		while ('\n' == toml2_lex_peek(lex, 0)) {
-			toml2_lex_advance(lex, true);
+			toml2_lex_advance(lex);
 			toml2_lex_eat_whitespace(lex);
 		}
 	}
 
-	// Then look for the triple end, noting that with """ \\n trims whitespace
-	// after the newline.
+	// Then look for the triple end. Escapes (including the """ \\n
+	// whitespace trim) are only validated here; the body is left as-is in
+	// the buffer and decoded when the token is extracted.
+	const char esc = q == '"' ? '\\' : q;
 	size_t pos = 0;
-	size_t quotes = 0;
-	UChar *wpos = lex->buf;
+	bool escaped = false;
+
+	for (;;) {
+		size_t run = toml2_scan_string(
+			lex->buf + pos,
+			lex->buf_left - pos,
+			q,
+			esc
+		);
+		pos += run;
 
-	for (;; pos += 1) {
 		ch = toml2_lex_peek(lex, pos);
 		if (0 == ch) {
-			lex->err.err = (q == '"')
-				? TOML2_UNCLOSED_TDQUOTE
-				: TOML2_UNCLOSED_TSQUOTE;
+			lex->err.err = unclosed;
 			return 1;
 		}
 
 		if ('\n' == ch) {
-			lex->line += 1;
-			lex->col = 1;
-		} else {
-			lex->col += 1;
+			pos += 1;
+			continue;
 		}
 
-		// With """, \\n trims whitespace until the next char isn't whitespace.
-		if ('\\' == ch && '"' == q && '\n' == toml2_lex_peek(lex, pos + 1)) {
-			pos += 2;
-			lex->line += 1;
-			lex->col = 1;
-
-			for (
-				UChar tmp = toml2_lex_peek(lex, pos + 1);
-				toml2_is_whitespace(tmp) || '\n' == tmp;
-				tmp = toml2_lex_peek(lex, pos + 1)
-			) {
-				lex->col += 1;
-				pos += 1;
+		if (q != ch) {
+			// A backslash in a """ string.
+			char next = toml2_lex_peek(lex, pos + 1);
+			if (0 == next) {
+				lex->err.err = unclosed;
+				return 1;
 			}
 
-			continue;
-		}
+			size_t off = '\n' == next ? 1 : toml2_lex_escape(lex, pos + 1);
+			if (0 == off) {
+				lex->err.err = TOML2_INVALID_ESCAPE;
+				return 1;
+			}
 
-		if (q == ch) {
-			quotes += 1;
-		} else {
-			quotes = 0;
+			escaped = true;
+			pos += off + 1;
+			continue;
 		}
 
-		if (quotes == 3) {
-			// The previous two quotes don't count, back up.
-			wpos -= 2;
-			pos -= 2;
+		if (
+			q == toml2_lex_peek(lex, pos + 1)
+			&& q == toml2_lex_peek(lex, pos + 2)
+		) {
 			break;
 		}
 
-		*wpos++ = ch;
+		pos += 1;
 	}
 
 	// For the emission, ignore the trailing '''/""".
-	size_t new_len = wpos - lex->buf;
-
-	// Then """ needs to be demangled.
-	if ('"' == q) {
-		if (0 != toml2_lex_demangle(lex, &new_len)) {
-			return 1;
-		}
-	}
+	toml2_lex_emit(lex, tok, pos, TOML2_TOKEN_STRING);
+	tok->escaped = escaped;
 
-	toml2_lex_emit(lex, tok, new_len, TOML2_TOKEN_STRING);
-	lex->buf += pos + 3;
-	lex->buf_left -= pos + 3;
+	toml2_lex_advance_n(lex, pos + 3);
 	return 0;
 }
 
@@ -482,7 +607,7 @@ toml2_lex_quote_any(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 
 	// If the next char is a quote, it's either an empty string or
 	// a triple quote.
-	UChar next = toml2_lex_peek(lex, 1);
+	char next = toml2_lex_peek(lex, 1);
 	if (0 == next) {
 		lex->err.err = q == '"'
 			? TOML2_UNCLOSED_DQUOTE
@@ -506,42 +631,132 @@ toml2_lex_quote_any(toml2_lex_t *lex, toml2_token_t *tok, uint32_t flags)
 	}
 }
 
+// toml2_lex_digits8 converts the 8 bytes at src into *out and returns true if
+// they're all ASCII digits, using SWAR arithmetic on a single 64-bit word
+// rather than a multiply per digit.
+static inline bool
+toml2_lex_digits8(const char *src, uint64_t *out)
+{
+	uint64_t v;
+	memcpy(&v, src, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+
+	// Every byte is in 0x30-0x39: the high nibble is 3, and stays 3 after
+	// adding 6.
+	if (
+		0x3030303030303030 != (v & 0xF0F0F0F0F0F0F0F0) ||
+		0x3030303030303030 != ((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0)
+	) {
+		return false;
+	}
+
+	// Combine adjacent digits pairwise into 2-, 4-, then 8-digit values.
+	v -= 0x3030303030303030;
+	v = (v * 10) + (v >> 8);
+	v = (
+		((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+		(((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))
+	) >> 32;
+
+	*out = (uint32_t) v;
+	return true;
+}
+
 static int
 toml2_lex_int(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 {
+	const char *src = lex->buf;
 	uint64_t val = 0;
-	int64_t sign = 1;
+	size_t digits = 0;
+	size_t pos = 0;
+	bool negative = false;
 	bool prev_number = false;
-	UChar prev_ch = 0;
-	UChar ch = 0;
 
-	for (size_t pos = 0; pos < len; pos += 1) {
-		prev_ch = ch;
-		ch = toml2_lex_peek(lex, pos);
+	if ('-' == src[0] || '+' == src[0]) {
+		negative = '-' == src[0];
+		pos = 1;
+	}
 
-		if (pos == 0) {
-			if ('-' == ch) {
-				sign = -1;
-				continue;
+	// Leading zeros verboten.
+	if (pos < len && '0' == src[pos] && (0 != pos || 1 < len)) {
+		lex->err.err = TOML2_INVALID_INT;
+		return 1;
+	}
 
-			} else if ('+' == ch) {
-				// pass
-				continue;
-			}
+	while (pos < len) {
+		// Eight digits at a time, while that can't possibly overflow.
+		uint64_t chunk;
+		if (digits <= 8 && pos + 8 <= len && toml2_lex_digits8(src + pos, &chunk)) {
+			val = val * 100000000 + chunk;
+			digits += 8;
+			pos += 8;
+			prev_number = true;
+			continue;
 		}
 
-		// Leading zeros verboten.
-		if ('0' == ch) {
-			if (0 == pos && 1 < len) {
-				lex->err.err = TOML2_INVALID_INT;
-				return 1;
-			}
-			else if (1 == pos && ('+' == prev_ch || '-' == prev_ch)) {
-				lex->err.err = TOML2_INVALID_INT;
+		char ch = src[pos];
+		pos += 1;
+
+		if ('_' == ch) {
+			if (!prev_number) {
+				lex->err.err = TOML2_INVALID_UNDERSCORE;
 				return 1;
 			}
+
+			prev_number = false;
+			continue;
 		}
 
+		if ('0' > ch || '9' < ch) {
+			lex->err.err = TOML2_INVALID_INT;
+			return 1;
+		}
+
+		if (
+			__builtin_mul_overflow(val, 10, &val) ||
+			__builtin_add_overflow(val, (uint64_t) (ch - '0'), &val)
+		) {
+			lex->err.err = TOML2_INVALID_INT;
+			return 1;
+		}
+
+		digits += 1;
+		prev_number = true;
+	}
+
+	if (!prev_number) {
+		lex->err.err = TOML2_INVALID_UNDERSCORE;
+		return 1;
+	}
+
+	// The magnitude of INT64_MIN is one more than INT64_MAX.
+	if (val > (uint64_t) INT64_MAX + (negative ? 1 : 0)) {
+		lex->err.err = TOML2_INVALID_INT;
+		return 1;
+	}
+
+	toml2_lex_emit(lex, tok, len, TOML2_TOKEN_INT);
+	tok->ival = negative ? (int64_t) (0 - val) : (int64_t) val;
+	toml2_lex_advance_n(lex, len);
+
+	return 0;
+}
+
+// toml2_lex_int_radix parses the 0x/0o/0b integer forms, which are unsigned
+// but must still fit in an int64_t. The first two bytes are the prefix.
+static int
+toml2_lex_int_radix(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
+{
+	const char *src = lex->buf;
+	int bits = 'x' == src[1] ? 4 : 'o' == src[1] ? 3 : 1;
+	uint64_t val = 0;
+	bool prev_number = false;
+
+	for (size_t pos = 2; pos < len; pos += 1) {
+		char ch = src[pos];
+
 		if ('_' == ch) {
 			if (!prev_number) {
 				lex->err.err = TOML2_INVALID_UNDERSCORE;
@@ -552,23 +767,27 @@ toml2_lex_int(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 			continue;
 		}
 
-		if ('0' > ch || '9' < ch) {
+		int digit = toml2_lex_hex(ch);
+		if (digit < 0 || digit >= (1 << bits)) {
+			lex->err.err = TOML2_INVALID_INT;
+			return 1;
+		}
+		if (val > ((uint64_t) INT64_MAX >> bits)) {
 			lex->err.err = TOML2_INVALID_INT;
 			return 1;
 		}
 
+		val = (val << bits) | (uint64_t) digit;
 		prev_number = true;
-		val *= 10;
-		val += ch - '0';
 	}
 
 	if (!prev_number) {
-		lex->err.err = TOML2_INVALID_UNDERSCORE;
+		lex->err.err = 2 == len ? TOML2_INVALID_INT : TOML2_INVALID_UNDERSCORE;
 		return 1;
 	}
 
 	toml2_lex_emit(lex, tok, len, TOML2_TOKEN_INT);
-	tok->ival = ((int64_t) val) * sign;
+	tok->ival = (int64_t) val;
 	toml2_lex_advance_n(lex, len);
 
 	return 0;
@@ -577,16 +796,20 @@ toml2_lex_int(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 static int
 toml2_lex_double(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 {
-	// NOTE: This implementation explicitly does not use strtod because it
-	// needs to be locale-independent; the behavior of strtod varies by locale.
-	// There's probably a better way to implement this but I'm too lazy to 
-	// re-read IEEE754 to make a bit-twiddly version.
-
-	double val = 0;
-	double exponent = 0;
-	double sign = 1;
-	double sign_exp = 1;
-	double relpos = 0;
+	// NOTE: This implementation explicitly does not use strtod up front
+	// because it needs to be locale-independent; the behavior of strtod
+	// varies by locale. The digits are collected into an integer mantissa
+	// and a power of ten, which toml2_float_fast can almost always turn into
+	// the correctly rounded double directly.
+
+	uint64_t mantissa = 0;
+	int64_t exp10 = 0;
+	int64_t exponent = 0;
+	size_t digits = 0;
+	bool truncated = false;
+	bool negative = false;
+	int64_t sign_exp = 1;
+	size_t relpos = 0;
 	bool prev_number = false;
 	enum {
 		MODE_INTEGER,
@@ -595,14 +818,14 @@ toml2_lex_double(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 	}
 	mode = MODE_INTEGER;
 
-	UChar ch;
+	char ch;
 
 	for (size_t pos = 0; pos < len; pos += 1) {
 		ch = toml2_lex_peek(lex, pos);
 
 		if (0 == relpos && '-' == ch && MODE_FRACTION != mode) {
 			if (MODE_INTEGER == mode) {
-				sign = -1;
+				negative = true;
 			}
 			else if (MODE_EXPONENT == mode) {
 				sign_exp = -1;
@@ -622,16 +845,9 @@ toml2_lex_double(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 			continue;
 		}
 
-		if ('0' == ch && MODE_INTEGER == mode) {
-			// This is allowed if the next character is the int/fraction
-			// separator.
-			if (pos + 1 < len && '.' == toml2_lex_peek(lex, pos + 1)) {
-				prev_number = true;
-				continue;
-			}
-
-			// Otherwise, leading zeros are not allowed.
-			if (0 == relpos || (1 == relpos && -1 == sign)) {
+		// Leading zeros are not allowed, except as the whole integer part.
+		if ('0' == ch && MODE_INTEGER == mode && 0 == relpos) {
+			if (pos + 1 >= len || '.' != toml2_lex_peek(lex, pos + 1)) {
 				lex->err.err = TOML2_INVALID_DOUBLE;
 				return 1;
 			}
@@ -680,20 +896,27 @@ toml2_lex_double(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 		}
 
 		if ('0' <= ch && '9' >= ch) {
-			switch (mode) {
-				case MODE_INTEGER:
-					val *= 10;
-					val += ch - '0';
-					break;
+			int digit = ch - '0';
 
-				case MODE_FRACTION:
-					val += ((double) (ch - '0')) / pow(10, (relpos + 1));
-					break;
-
-				case MODE_EXPONENT:
-					exponent *= 10;
-					exponent += ch - '0';
-					break;
+			if (MODE_EXPONENT == mode) {
+				// Anything this large is 0 or infinity anyway.
+				if (exponent < 100000) {
+					exponent = exponent * 10 + digit;
+				}
+			}
+			else if (0 == mantissa && 0 == digit) {
+				// Leading zeros aren't significant.
+				exp10 -= MODE_FRACTION == mode ? 1 : 0;
+			}
+			else if (digits < 19) {
+				// 19 digits always fit in a uint64_t.
+				mantissa = mantissa * 10 + digit;
+				digits += 1;
+				exp10 -= MODE_FRACTION == mode ? 1 : 0;
+			}
+			else {
+				exp10 += MODE_INTEGER == mode ? 1 : 0;
+				truncated = truncated || 0 != digit;
 			}
 
 			relpos += 1;
@@ -713,16 +936,169 @@ toml2_lex_double(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 		return 1;
 	}
 
-	val *= sign;
-	exponent *= sign_exp;
+	if (lex->lazy) {
+		toml2_lex_emit(lex, tok, len, TOML2_TOKEN_DOUBLE);
+		tok->fval = 0;
+		toml2_lex_advance_n(lex, len);
+		return 0;
+	}
+
+	exp10 += sign_exp * exponent;
+
+	// With more than 19 significant digits, the true value lies between
+	// mantissa and mantissa + 1; if both round the same way, so does it.
+	double val, upper;
+	bool ok = toml2_float_fast(mantissa, exp10, negative, &val);
+	if (ok && truncated) {
+		ok = toml2_float_fast(mantissa + 1, exp10, negative, &upper);
+		ok = ok && val == upper;
+	}
+
+	if (!ok) {
+		if (0 != toml2_float_exact(lex->buf, len, &val)) {
+			lex->err.err = TOML2_NO_MEMORY;
+			return 1;
+		}
+	}
 
 	toml2_lex_emit(lex, tok, len, TOML2_TOKEN_DOUBLE);
-	tok->fval = val * pow(10, exponent);
+	tok->fval = val;
 	toml2_lex_advance_n(lex, len);
 
 	return 0;
 }
 
+// toml2_lex_fixed8 checks that the 8 bytes at src hold ASCII digits wherever
+// digits has 0xFF and exactly the bytes of seps everywhere else, except for
+// the bytes skip has 0xFF in. The digit values are written to out.
+static inline bool
+toml2_lex_fixed8(
+	const char *src,
+	uint64_t digits,
+	uint64_t seps,
+	uint64_t skip,
+	uint8_t out[8]
+) {
+	uint64_t v;
+	memcpy(&v, src, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+
+	uint64_t d = v & digits;
+	if (
+		seps != (v & ~digits & ~skip) ||
+		(0x3030303030303030 & digits) != (d & 0xF0F0F0F0F0F0F0F0) ||
+		(0x3030303030303030 & digits) !=
+			((d + (0x0606060606060606 & digits)) & 0xF0F0F0F0F0F0F0F0)
+	) {
+		return false;
+	}
+
+	d -= 0x3030303030303030 & digits;
+	for (size_t i = 0; i < 8; i += 1) {
+		out[i] = (uint8_t) (d >> (8 * i));
+	}
+	return true;
+}
+
+static inline bool
+toml2_lex_digit2(const char *src, int *out)
+{
+	if ('0' > src[0] || '9' < src[0] || '0' > src[1] || '9' < src[1]) {
+		return false;
+	}
+
+	*out = 10 * (src[0] - '0') + (src[1] - '0');
+	return true;
+}
+
+// toml2_lex_date_fast handles the canonical YYYY-MM-DD and
+// YYYY-MM-DDTHH:MM:SS[.frac](Z|+HH:MM|-HH:MM) layouts, where every field is
+// at a fixed offset and can be pulled out a word at a time. Anything else
+// returns false and is left to the general state machine in toml2_lex_date,
+// which also takes care of reporting errors.
+static bool
+toml2_lex_date_fast(const char *src, size_t len, toml2_token_t *tok)
+{
+	uint8_t a[8], b[8];
+	int sec;
+
+	// "YYYY-MM-" then "DDTHH:MM"; the T is checked separately since it's
+	// case-insensitive. Shorter tokens can't be read a word at a time.
+	if (10 == len) {
+		if (!toml2_lex_fixed8(src, 0x00FFFF00FFFFFFFF, 0x2D0000002D000000, 0, a)) {
+			return false;
+		}
+		if (!toml2_lex_digit2(src + 8, &tok->time.tm_mday)) {
+			return false;
+		}
+	}
+	else if (len >= 20) {
+		if (
+			!toml2_lex_fixed8(src, 0x00FFFF00FFFFFFFF, 0x2D0000002D000000, 0, a) ||
+			!toml2_lex_fixed8(src + 8, 0xFFFF00FFFF00FFFF, 0x00003A0000000000, 0x0000000000FF0000, b) ||
+			('T' != src[10] && 't' != src[10]) ||
+			':' != src[16] ||
+			!toml2_lex_digit2(src + 17, &sec)
+		) {
+			return false;
+		}
+
+		tok->time.tm_mday = 10 * b[0] + b[1];
+		tok->time.tm_hour = 10 * b[3] + b[4];
+		tok->time.tm_min = 10 * b[6] + b[7];
+		tok->time.tm_sec = sec;
+	}
+	else {
+		return false;
+	}
+
+	tok->time.tm_year = 1000 * a[0] + 100 * a[1] + 10 * a[2] + a[3];
+	tok->time.tm_mon = 10 * a[5] + a[6] - 1;
+
+	if (10 == len) {
+		return true;
+	}
+
+	size_t pos = 19;
+	if ('.' == src[pos]) {
+		int32_t nsec = 0;
+		size_t ndigits = 0;
+
+		for (pos += 1; pos < len && '0' <= src[pos] && '9' >= src[pos]; pos += 1) {
+			if (ndigits < 9) {
+				nsec = nsec * 10 + (src[pos] - '0');
+				ndigits += 1;
+			}
+		}
+		for (; ndigits < 9; ndigits += 1) {
+			nsec *= 10;
+		}
+
+		tok->time_nsec = nsec;
+	}
+
+	if (pos + 1 == len && ('Z' == src[pos] || 'z' == src[pos])) {
+		return true;
+	}
+
+	int off_h, off_m;
+	if (
+		pos + 6 == len &&
+		('+' == src[pos] || '-' == src[pos]) &&
+		toml2_lex_digit2(src + pos + 1, &off_h) &&
+		':' == src[pos + 3] &&
+		toml2_lex_digit2(src + pos + 4, &off_m)
+	) {
+		tok->time_offset = ('-' == src[pos] ? -1 : 1) * (off_h * 3600 + off_m * 60);
+		tok->time.tm_gmtoff = tok->time_offset;
+		return true;
+	}
+
+	return false;
+}
+
 static int
 toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 {
@@ -741,10 +1117,21 @@ toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 	mode = MODE_YEAR;
 
 	int32_t val = 0, spare = 0, sign = 1;
-	size_t num_digits = 0;
-	UChar ch = 0, prev_ch;
+	int32_t nsec = 0;
+	size_t num_digits = 0, nsec_digits = 0;
+	char ch = 0, prev_ch;
 
 	bzero(&tok->time, sizeof(struct tm));
+	tok->time_nsec = 0;
+	tok->time_offset = 0;
+
+	if (toml2_lex_date_fast(lex->buf, len, tok)) {
+		goto done;
+	}
+
+	bzero(&tok->time, sizeof(struct tm));
+	tok->time_nsec = 0;
+	tok->time_offset = 0;
 
 	// XXX: This could just be implemented as a state table, but alas.
 #	define NEXT_MODE(NEXT, FIELD, NUM_DIGIT) \
@@ -830,6 +1217,14 @@ toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 			}
 		}
 
+		if ('0' <= ch && '9' >= ch && MODE_NANOSECOND == mode) {
+			if (nsec_digits < 9) {
+				nsec = nsec * 10 + (ch - '0');
+				nsec_digits += 1;
+			}
+			continue;
+		}
+
 		if ('0' <= ch && '9' >= ch) {
 			val *= 10;
 			val += ch - '0';
@@ -841,6 +1236,11 @@ toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 		return 1;
 	}
 
+	for (; 0 < nsec_digits && nsec_digits < 9; nsec_digits += 1) {
+		nsec *= 10;
+	}
+	tok->time_nsec = nsec;
+
 	for (size_t i = 0; i < 1; i += 1) {
 		switch (mode) {
 			case MODE_DAY: NEXT_MODE(MODE_DONE, tok->time.tm_mday, 2);
@@ -852,7 +1252,8 @@ toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 					break;
 				}
 
-				tok->time.tm_gmtoff = sign * ((60 * 60 * spare) + val);
+				tok->time_offset = sign * ((60 * 60 * spare) + (60 * val));
+				tok->time.tm_gmtoff = tok->time_offset;
 				mode = MODE_DONE;
 				break;
 
@@ -865,6 +1266,7 @@ toml2_lex_date(toml2_lex_t *lex, toml2_token_t *tok, size_t len)
 	}
 #	undef NEXT_MODE
 
+	done:
 	toml2_lex_emit(lex, tok, len, TOML2_TOKEN_DATE);
 	toml2_lex_advance_n(lex, len);
 	return 0;
@@ -877,12 +1279,33 @@ toml2_lex_value(toml2_lex_t *lex, toml2_token_t *tok)
 	size_t pos = 0;
 	toml2_token_type_t type = TOML2_TOKEN_INT;
 
-	UChar ch = 0, prev_ch;
+	char ch = 0, prev_ch;
 
+	// 0x, 0o and 0b integers run for as long as there are hex digits or
+	// underscores; which digits are valid is up to toml2_lex_int_radix.
+	ch = toml2_lex_peek(lex, 1);
+	if ('0' == toml2_lex_peek(lex, 0) && ('x' == ch || 'o' == ch || 'b' == ch)) {
+		for (pos = 2;; pos += 1) {
+			ch = toml2_lex_peek(lex, pos);
+			if ('_' != ch && toml2_lex_hex(ch) < 0) {
+				break;
+			}
+		}
+
+		return toml2_lex_int_radix(lex, tok, pos);
+	}
+
+	ch = 0;
 	for (;; pos += 1) {
 		prev_ch = ch;
 		ch = toml2_lex_peek(lex, pos);
 
+		uint8_t cc = toml2_lex_classify(ch);
+		if (!(cc & TOML2_CH_IN_VALUE)) {
+			// No more characters left to parse.
+			break;
+		}
+
 		if ('-' == ch) {
 			// A date has a '-' anywhere in it, except as the first character
 			// (which is valid for ints+doubles) or after an 'eE' (which is
@@ -892,27 +1315,17 @@ toml2_lex_value(toml2_lex_t *lex, toml2_token_t *tok)
 				type = TOML2_TOKEN_DATE;
 			}
 		}
-		else if ('t' == ch || 'T' == ch || 'z' == ch || 'Z' == ch || ':' == ch) {
+		else if (cc & TOML2_CH_DATE) {
 			// Date-only chars.
 			type = TOML2_TOKEN_DATE;
 		}
-		else if ('e' == ch || 'E' == ch || '.' == ch) {
+		else if (cc & TOML2_CH_DOUBLE) {
 			// A '.' can appear in both dates and doubles -- the dates will
 			// always have it appear after '-', so give it higher points.
 			if (type != TOML2_TOKEN_DATE) {
 				type = TOML2_TOKEN_DOUBLE;
 			}
 		}
-		else if ('0' <= ch && '9' >= ch) {
-			// pass.
-		}
-		else if ('+' == ch || '_' == ch) {
-			// pass.
-		}
-		else {
-			// No more characters left to parse.
-			break;
-		}
 	}
 
 	if (0 == pos) {
@@ -943,30 +1356,14 @@ toml2_lex_id(toml2_lex_t *lex, toml2_token_t *tok)
 	// be in identifiers and strictly defines "whitespace" as a 
 	// whitelist, so this implementation just includes literally anything
 	// as a valid identifier.
-	const UChar reserved[] = {
-		'.', ',', '=', '[', ']', '{', '}', ':', '#'
-	};
-	
+	// Whitespace, NUL and the punctuation characters are TOML2_CH_ID_END.
 	size_t pos = 0;
-
-	for (;; pos += 1) {
-		UChar ch = toml2_lex_peek(lex, pos);
-
-		if (0 == ch) {
-			break;
-		}
-		
-		if (toml2_is_whitespace(ch) || '\n' == ch) {
-			break;
-		}
-
-		for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i += 1) {
-			if (reserved[i] == ch) {
-				goto found;
-			}
-		}
+	while (
+		pos < lex->buf_left &&
+		!(toml2_lex_classify(lex->buf[pos]) & TOML2_CH_ID_END)
+	) {
+		pos += 1;
 	}
-	found:
 
 	if (0 == pos) {
 		// This *should* be unreachable since we should have chomped all 
@@ -980,73 +1377,119 @@ toml2_lex_id(toml2_lex_t *lex, toml2_token_t *tok)
 	return 0;
 }
 
-int
-toml2_lex_token(toml2_lex_t *lex, toml2_token_t *tok)
+static int
+toml2_lex_next(toml2_lex_t *lex, toml2_token_t *tok)
 {
 	toml2_lex_eat_whitespace(lex);
 
 	if (0 == lex->buf_left) {
-		tok->type = TOML2_TOKEN_EOF;
-		return 0;
+		return toml2_lex_emit(lex, tok, 0, TOML2_TOKEN_EOF);
 	}
 
-	UChar p = lex->buf[0];
-	
-	// Try the single-char tokens first.
-	const struct {
-		char               val;
-		toml2_token_type_t type;
-		bool               advance;
-	}
-	singles[] = {
-		{ '\n', TOML2_TOKEN_NEWLINE,       true, },
-		{ '[',  TOML2_TOKEN_BRACKET_OPEN,  false },
-		{ ']',  TOML2_TOKEN_BRACKET_CLOSE, false },
-		{ '{',  TOML2_TOKEN_BRACE_OPEN,    false },
-		{ '}',  TOML2_TOKEN_BRACE_CLOSE,   false },
-		{ '=',  TOML2_TOKEN_EQUALS,        false },
-		{ ',',  TOML2_TOKEN_COMMA,         false },
-		{ '.',  TOML2_TOKEN_DOT,           false },
+	// Single-character tokens map straight from their class.
+	static const toml2_token_type_t singles[] = {
+		[TOML2_CH_NEWLINE]       = TOML2_TOKEN_NEWLINE,
+		[TOML2_CH_BRACKET_OPEN]  = TOML2_TOKEN_BRACKET_OPEN,
+		[TOML2_CH_BRACKET_CLOSE] = TOML2_TOKEN_BRACKET_CLOSE,
+		[TOML2_CH_BRACE_OPEN]    = TOML2_TOKEN_BRACE_OPEN,
+		[TOML2_CH_BRACE_CLOSE]   = TOML2_TOKEN_BRACE_CLOSE,
+		[TOML2_CH_EQUALS]        = TOML2_TOKEN_EQUALS,
+		[TOML2_CH_COMMA]         = TOML2_TOKEN_COMMA,
+		[TOML2_CH_DOT]           = TOML2_TOKEN_DOT,
 	};
-	for (size_t i = 0; i < sizeof(singles) / sizeof(singles[0]); i += 1) {
-		if (singles[i].val == p) {
-			tok->type = singles[i].type;
-			toml2_lex_advance(lex, singles[i].advance);
-			return 0;
-		}
+
+	uint8_t state = toml2_lex_classify(lex->buf[0]) & TOML2_CH_START;
+
+	// Values always start with [+-0-9] and are ints, doubles or dates. For
+	// the lexer's purposes, booleans are left as identifiers since they're
+	// context-specific; so is anything else that doesn't start a token.
+#if defined(__GNUC__)
+	static const void *dispatch[] = {
+		[TOML2_CH_ID]            = &&id,
+		[TOML2_CH_NEWLINE]       = &&newline,
+		[TOML2_CH_BRACKET_OPEN]  = &&single,
+		[TOML2_CH_BRACKET_CLOSE] = &&single,
+		[TOML2_CH_BRACE_OPEN]    = &&single,
+		[TOML2_CH_BRACE_CLOSE]   = &&single,
+		[TOML2_CH_EQUALS]        = &&single,
+		[TOML2_CH_COMMA]         = &&single,
+		[TOML2_CH_DOT]           = &&single,
+		[TOML2_CH_COMMENT]       = &&comment,
+		[TOML2_CH_SQUOTE]        = &&squote,
+		[TOML2_CH_DQUOTE]        = &&dquote,
+		[TOML2_CH_VALUE]         = &&value,
+	};
+	goto *dispatch[state];
+#else
+	switch (state) {
+		case TOML2_CH_NEWLINE: goto newline;
+		case TOML2_CH_BRACKET_OPEN:
+		case TOML2_CH_BRACKET_CLOSE:
+		case TOML2_CH_BRACE_OPEN:
+		case TOML2_CH_BRACE_CLOSE:
+		case TOML2_CH_EQUALS:
+		case TOML2_CH_COMMA:
+		case TOML2_CH_DOT: goto single;
+		case TOML2_CH_COMMENT: goto comment;
+		case TOML2_CH_SQUOTE: goto squote;
+		case TOML2_CH_DQUOTE: goto dquote;
+		case TOML2_CH_VALUE: goto value;
+		default: goto id;
 	}
+#endif
+
+	newline:
+		toml2_lex_emit(lex, tok, 1, TOML2_TOKEN_NEWLINE);
+		toml2_lex_advance(lex);
+		toml2_lex_eat_newlines(lex);
+		return 0;
+	single:
+		toml2_lex_emit(lex, tok, 1, singles[state]);
+		toml2_lex_advance(lex);
+		return 0;
+	comment:
+		return toml2_lex_comment(lex, tok, 0);
+	squote:
+		return toml2_lex_quote_any(lex, tok, TOML2_QUOTE_SINGLE);
+	dquote:
+		return toml2_lex_quote_any(lex, tok, 0);
+	value:
+		return toml2_lex_value(lex, tok);
+	id:
+		return toml2_lex_id(lex, tok);
+}
 
-	// Then the more complicated tokens.
-	const struct {
-		char         val;
-		toml2_lex_fn fn;
-		uint32_t     flags;
+int
+toml2_lex_token(toml2_lex_t *lex, toml2_token_t *tok)
+{
+	if (0 == toml2_lex_next(lex, tok)) {
+		return 0;
 	}
-	multis[] = {
-		{ '#',  &toml2_lex_comment,     0                  },
-		{ '\'', &toml2_lex_quote_any,   TOML2_QUOTE_SINGLE },
-		{ '"',  &toml2_lex_quote_any,   0                  },
-	};
-	for (size_t i = 0; i < sizeof(multis) / sizeof(multis[0]); i += 1) {
-		if (multis[i].val == p) {
-			return multis[i].fn(lex, tok, multis[i].flags);
-		}
+
+	// Only now that there's an error is the position worth working out;
+	// it's wherever the lexer gave up.
+	toml2_lex_locate(lex, toml2_lex_pos(lex), &lex->err.line, &lex->err.col);
+	if (TOML2_NO_ERROR == lex->err.err) {
+		lex->err.err = TOML2_INTERNAL_ERROR;
 	}
+	return lex->err.err;
+}
 
-	// Left are identifiers and values; values always start with either
-	// [.+-1-9] and are ints, doubles or dates. For the lexer's purposes,
-	// booleans are left as identifiers since they're context-specific.
-	const char v_starts[] = {
-		'+', '-', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '.'
-	};
-	for (size_t i = 0; i < sizeof(v_starts) / sizeof(v_starts[0]); i += 1) {
-		if (v_starts[i] == p) {
-			return toml2_lex_value(lex, tok);
-		}
+// toml2_token_decode writes the UTF8 value of tok into dst, which must have
+// room for at least tok->end - tok->start bytes, and returns the length
+// written. Escape-free tokens are a straight copy out of the input.
+static size_t
+toml2_token_decode(toml2_lex_t *lex, toml2_token_t *tok, char *dst)
+{
+	const char *src = lex->buf_start + tok->start;
+	size_t srclen = tok->end - tok->start;
+
+	if (!tok->escaped) {
+		memcpy(dst, src, srclen);
+		return srclen;
 	}
 
-	// Identifiers are tried last.
-	return toml2_lex_id(lex, tok);
+	return toml2_lex_unescape(src, srclen, dst);
 }
 
 const char*
@@ -1054,48 +1497,75 @@ toml2_token_dbg_utf8(toml2_lex_t *lex, toml2_token_t *tok)
 {
 	static char buf[256];
 
-	int32_t srclen = tok->end - tok->start;
-	if (0 == srclen) {
-		return "";
-	}
-
-	UErrorCode uerr = 0;
-	u_strToUTF8(buf, sizeof(buf), NULL, lex->buf_start + tok->start, srclen, &uerr);
-	if (0 != toml2_check_uerr(lex, uerr)) {
+	size_t srclen = tok->end - tok->start;
+	if (srclen >= sizeof(buf)) {
 		return NULL;
 	}
 
+	buf[toml2_token_decode(lex, tok, buf)] = 0;
 	return buf;
 }
 
+size_t
+toml2_token_copy(toml2_lex_t *lex, toml2_token_t *tok, char *dst)
+{
+	size_t len = toml2_token_decode(lex, tok, dst);
+	dst[len] = 0;
+	return len;
+}
+
 char*
 toml2_token_utf8(toml2_lex_t *lex, toml2_token_t *tok)
 {
-	UErrorCode uerr = 0;
-	int32_t srclen = tok->end - tok->start;
-	int32_t dstlen = 0;
-	int ret;
+	size_t len;
+	return toml2_token_utf8_len(lex, tok, &len);
+}
 
-	if (0 == srclen) {
-		return strdup("");
+char*
+toml2_token_utf8_len(toml2_lex_t *lex, toml2_token_t *tok, size_t *len)
+{
+	char *buf = malloc(tok->end - tok->start + 1);
+	if (NULL == buf) {
+		lex->err.err = TOML2_NO_MEMORY;
+		return NULL;
 	}
 
-	u_strToUTF8(NULL, 0, &dstlen, lex->buf_start + tok->start, srclen, &uerr);
-	if (U_BUFFER_OVERFLOW_ERROR != uerr) {
-		if (0 != (ret = toml2_check_uerr(lex, uerr))) {
-			return NULL;
-		}
+	*len = toml2_token_decode(lex, tok, buf);
+	buf[*len] = 0;
+	return buf;
+}
+
+const char*
+toml2_token_view(toml2_lex_t *lex, toml2_token_t *tok, size_t *len)
+{
+	if (tok->escaped) {
+		return NULL;
 	}
 
-	char *buf = malloc(dstlen + 1);
-	buf[dstlen] = 0;
-	uerr = 0;
+	*len = tok->end - tok->start;
+	return lex->buf_start + tok->start;
+}
 
-	u_strToUTF8(buf, dstlen, NULL, lex->buf_start + tok->start, srclen, &uerr);
-	if (0 != (ret = toml2_check_uerr(lex, uerr))) {
-		free(buf);
-		return NULL;
+size_t
+toml2_lex_decode_str(const char *src, size_t len, char *dst)
+{
+	size_t w = toml2_lex_unescape(src, len, dst);
+	dst[w] = 0;
+	return w;
+}
+
+int
+toml2_lex_decode_double(const char *src, size_t len, double *out)
+{
+	toml2_lex_t lex = { 0 };
+	toml2_token_t tok;
+
+	lex.buf_start = lex.buf = src;
+	lex.buf_len = lex.buf_left = len;
+	if (0 != toml2_lex_double(&lex, &tok, len)) {
+		return lex.err.err;
 	}
 
-	return buf;
+	*out = tok.fval;
+	return 0;
 }
@@ -0,0 +1,169 @@
+#include "toml2-proj.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// toml2_proj_any reports whether proj is a "*" node.
+static bool
+toml2_proj_any(const toml2_proj_t *proj)
+{
+	return 1 == proj->name_len && '*' == proj->name[0];
+}
+
+// toml2_proj_child returns the child of proj named by the len bytes at name,
+// adding it if there isn't one yet, or NULL if out of memory.
+static toml2_proj_t*
+toml2_proj_child(toml2_proj_t *proj, const char *name, size_t len)
+{
+	for (size_t i = 0; i < proj->children_len; i += 1) {
+		toml2_proj_t *child = &proj->children[i];
+		if (len == child->name_len && 0 == memcmp(name, child->name, len)) {
+			return child;
+		}
+	}
+
+	size_t new_len = proj->children_len + 1;
+	void *new_data = realloc(proj->children, new_len * sizeof(toml2_proj_t));
+	if (NULL == new_data) {
+		return NULL;
+	}
+	proj->children = new_data;
+
+	toml2_proj_t *child = &proj->children[proj->children_len];
+	bzero(child, sizeof(*child));
+	child->name = malloc(len + 1);
+	if (NULL == child->name) {
+		return NULL;
+	}
+	memcpy(child->name, name, len);
+	child->name[len] = 0;
+	child->name_len = len;
+	proj->children_len = new_len;
+
+	// Parts that are numbers match list indexes the way toml2_get_path
+	// reads them.
+	char *end = NULL;
+	child->index = strtol(child->name, &end, 10);
+	child->is_index = 0 != len && 0 == *end;
+
+	return child;
+}
+
+// toml2_proj_merge adds everything src matches to dst.
+static int
+toml2_proj_merge(toml2_proj_t *dst, const toml2_proj_t *src)
+{
+	dst->all = dst->all || src->all;
+
+	for (size_t i = 0; i < src->children_len; i += 1) {
+		const toml2_proj_t *from = &src->children[i];
+		toml2_proj_t *to = toml2_proj_child(dst, from->name, from->name_len);
+		if (NULL == to || 0 != toml2_proj_merge(to, from)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// toml2_proj_spread merges each "*" node under proj into its siblings.
+static int
+toml2_proj_spread(toml2_proj_t *proj)
+{
+	toml2_proj_t *any = NULL;
+	for (size_t i = 0; i < proj->children_len; i += 1) {
+		if (toml2_proj_any(&proj->children[i])) {
+			any = &proj->children[i];
+		}
+	}
+
+	for (size_t i = 0; NULL != any && i < proj->children_len; i += 1) {
+		toml2_proj_t *child = &proj->children[i];
+		if (child != any && 0 != toml2_proj_merge(child, any)) {
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < proj->children_len; i += 1) {
+		if (0 != toml2_proj_spread(&proj->children[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int
+toml2_proj_init(toml2_proj_t *root, const char *const *paths, size_t paths_len)
+{
+	for (size_t i = 0; i < paths_len; i += 1) {
+		char *dup = strdup(paths[i]);
+		if (NULL == dup) {
+			return 1;
+		}
+
+		char *work, *tmp;
+		toml2_proj_t *proj = root;
+		for (
+			work = strtok_r(dup, ".", &tmp);
+			NULL != work && NULL != proj;
+			work = strtok_r(NULL, ".", &tmp)
+		) {
+			proj = toml2_proj_child(proj, work, strlen(work));
+		}
+
+		free(dup);
+		if (NULL == proj) {
+			return 1;
+		}
+		proj->all = true;
+	}
+
+	return toml2_proj_spread(root);
+}
+
+const toml2_proj_t*
+toml2_proj_find(const toml2_proj_t *proj, const char *name, size_t len)
+{
+	const toml2_proj_t *any = NULL;
+	for (size_t i = 0; i < proj->children_len; i += 1) {
+		const toml2_proj_t *child = &proj->children[i];
+		if (len == child->name_len && 0 == memcmp(name, child->name, len)) {
+			return child;
+		}
+		if (toml2_proj_any(child)) {
+			any = child;
+		}
+	}
+
+	return any;
+}
+
+const toml2_proj_t*
+toml2_proj_find_index(const toml2_proj_t *proj, size_t idx)
+{
+	const toml2_proj_t *any = NULL;
+	for (size_t i = 0; i < proj->children_len; i += 1) {
+		const toml2_proj_t *child = &proj->children[i];
+		if (child->is_index && idx == child->index) {
+			return child;
+		}
+		if (toml2_proj_any(child)) {
+			any = child;
+		}
+	}
+
+	return any;
+}
+
+void
+toml2_proj_free(toml2_proj_t *root)
+{
+	for (size_t i = 0; i < root->children_len; i += 1) {
+		toml2_proj_free(&root->children[i]);
+	}
+
+	free(root->name);
+	free(root->children);
+	bzero(root, sizeof(*root));
+}
@@ -0,0 +1,533 @@
+#include "toml2-scan.h"
+#include <stdbool.h>
+
+// Each kernel runs over whole blocks of TOML2_VEC_LEN bytes, producing a
+// bitmask with one bit per byte, and finishes the tail (or everything, when
+// there's no vector unit) one byte at a time.
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define TOML2_VEC_LEN 32
+#	define TOML2_VEC_FULL 0xFFFFFFFFu
+
+typedef __m256i toml2_vec_t;
+
+static inline toml2_vec_t
+toml2_vec_load(const char *p)
+{
+	return _mm256_loadu_si256((const __m256i*) p);
+}
+
+static inline uint32_t
+toml2_vec_eq(toml2_vec_t v, char ch)
+{
+	return (uint32_t) _mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch))
+	);
+}
+
+static inline uint32_t
+toml2_vec_high(toml2_vec_t v)
+{
+	return (uint32_t) _mm256_movemask_epi8(v);
+}
+
+#	define TOML2_VEC_SHUFFLE 1
+#	define toml2_vec_zero() _mm256_setzero_si256()
+#	define toml2_vec_set1(x) _mm256_set1_epi8((char) (x))
+#	define toml2_vec_and(a, b) _mm256_and_si256((a), (b))
+#	define toml2_vec_or(a, b) _mm256_or_si256((a), (b))
+#	define toml2_vec_xor(a, b) _mm256_xor_si256((a), (b))
+#	define toml2_vec_subs(a, b) _mm256_subs_epu8((a), (b))
+#	define toml2_vec_shr4(a) _mm256_srli_epi16((a), 4)
+#	define toml2_vec_any(a) (!_mm256_testz_si256((a), (a)))
+#	define toml2_vec_lookup(t, i) _mm256_shuffle_epi8((t), (i))
+#	define toml2_vec_table(t) \
+		_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (t)))
+#	define toml2_vec_prev(in, prev, n) _mm256_alignr_epi8( \
+		(in), \
+		_mm256_permute2x128_si256((prev), (in), 0x21), \
+		16 - (n) \
+	)
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#	define TOML2_VEC_LEN 16
+#	define TOML2_VEC_FULL 0xFFFFu
+
+typedef __m128i toml2_vec_t;
+
+static inline toml2_vec_t
+toml2_vec_load(const char *p)
+{
+	return _mm_loadu_si128((const __m128i*) p);
+}
+
+static inline uint32_t
+toml2_vec_eq(toml2_vec_t v, char ch)
+{
+	return (uint32_t) _mm_movemask_epi8(
+		_mm_cmpeq_epi8(v, _mm_set1_epi8(ch))
+	);
+}
+
+static inline uint32_t
+toml2_vec_high(toml2_vec_t v)
+{
+	return (uint32_t) _mm_movemask_epi8(v);
+}
+
+// The UTF-8 validator needs a byte shuffle, which SSE2 alone doesn't have;
+// without SSSE3 only its ASCII fast path is vectorized.
+#	if defined(__SSSE3__)
+#		include <tmmintrin.h>
+#		define TOML2_VEC_SHUFFLE 1
+#		define toml2_vec_zero() _mm_setzero_si128()
+#		define toml2_vec_set1(x) _mm_set1_epi8((char) (x))
+#		define toml2_vec_and(a, b) _mm_and_si128((a), (b))
+#		define toml2_vec_or(a, b) _mm_or_si128((a), (b))
+#		define toml2_vec_xor(a, b) _mm_xor_si128((a), (b))
+#		define toml2_vec_subs(a, b) _mm_subs_epu8((a), (b))
+#		define toml2_vec_shr4(a) _mm_srli_epi16((a), 4)
+#		define toml2_vec_any(a) (0xFFFF != _mm_movemask_epi8( \
+			_mm_cmpeq_epi8((a), _mm_setzero_si128()) \
+		))
+#		define toml2_vec_lookup(t, i) _mm_shuffle_epi8((t), (i))
+#		define toml2_vec_table(t) _mm_loadu_si128((const __m128i*) (t))
+#		define toml2_vec_prev(in, prev, n) \
+			_mm_alignr_epi8((in), (prev), 16 - (n))
+#	endif
+#endif
+
+static inline bool
+toml2_scan_is_blank(char ch)
+{
+	return ' ' == ch || '\t' == ch || '\r' == ch;
+}
+
+size_t
+toml2_scan_blank(const char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	// Most tokens aren't preceded by any whitespace at all; don't bother
+	// loading a whole block for those.
+	if (0 == len || !toml2_scan_is_blank(buf[0])) {
+		return 0;
+	}
+
+#ifdef TOML2_VEC_LEN
+	for (; pos + TOML2_VEC_LEN <= len; pos += TOML2_VEC_LEN) {
+		toml2_vec_t v = toml2_vec_load(buf + pos);
+		uint32_t mask = toml2_vec_eq(v, ' ')
+			| toml2_vec_eq(v, '\t')
+			| toml2_vec_eq(v, '\r');
+
+		if (TOML2_VEC_FULL != mask) {
+			return pos + __builtin_ctz(~mask);
+		}
+	}
+#endif
+
+	while (pos < len && toml2_scan_is_blank(buf[pos])) {
+		pos += 1;
+	}
+
+	return pos;
+}
+
+size_t
+toml2_scan_space(const char *buf, size_t len)
+{
+	size_t pos = 0;
+
+#ifdef TOML2_VEC_LEN
+	for (; pos + TOML2_VEC_LEN <= len; pos += TOML2_VEC_LEN) {
+		toml2_vec_t v = toml2_vec_load(buf + pos);
+		uint32_t mask = toml2_vec_eq(v, '\n')
+			| toml2_vec_eq(v, ' ')
+			| toml2_vec_eq(v, '\t')
+			| toml2_vec_eq(v, '\r');
+
+		if (TOML2_VEC_FULL != mask) {
+			return pos + __builtin_ctz(~mask);
+		}
+	}
+#endif
+
+	while (pos < len && ('\n' == buf[pos] || toml2_scan_is_blank(buf[pos]))) {
+		pos += 1;
+	}
+
+	return pos;
+}
+
+size_t
+toml2_scan_newline(const char *buf, size_t len)
+{
+	size_t pos = 0;
+
+#ifdef TOML2_VEC_LEN
+	for (; pos + TOML2_VEC_LEN <= len; pos += TOML2_VEC_LEN) {
+		uint32_t mask = toml2_vec_eq(toml2_vec_load(buf + pos), '\n');
+		if (0 != mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	while (pos < len && '\n' != buf[pos]) {
+		pos += 1;
+	}
+
+	return pos;
+}
+
+size_t
+toml2_scan_string(const char *buf, size_t len, char q, char esc)
+{
+	size_t pos = 0;
+
+#ifdef TOML2_VEC_LEN
+	for (; pos + TOML2_VEC_LEN <= len; pos += TOML2_VEC_LEN) {
+		toml2_vec_t v = toml2_vec_load(buf + pos);
+		uint32_t mask = toml2_vec_eq(v, q)
+			| toml2_vec_eq(v, esc)
+			| toml2_vec_eq(v, '\n')
+			| toml2_vec_eq(v, 0);
+
+		if (0 != mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	for (; pos < len; pos += 1) {
+		char ch = buf[pos];
+		if (q == ch || esc == ch || '\n' == ch || 0 == ch) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+// toml2_utf8_seq returns the length of the well-formed UTF-8 sequence at
+// buf[pos], or 0 if there isn't one.
+static size_t
+toml2_utf8_seq(const uint8_t *buf, size_t len, size_t pos)
+{
+	uint8_t ch = buf[pos];
+	uint8_t lo = 0x80, hi = 0xBF;
+	size_t need;
+
+	if (ch < 0x80) {
+		return 1;
+	}
+	else if (ch >= 0xC2 && ch <= 0xDF) {
+		need = 1;
+	}
+	else if (ch >= 0xE0 && ch <= 0xEF) {
+		need = 2;
+		lo = 0xE0 == ch ? 0xA0 : lo;
+		hi = 0xED == ch ? 0x9F : hi;
+	}
+	else if (ch >= 0xF0 && ch <= 0xF4) {
+		need = 3;
+		lo = 0xF0 == ch ? 0x90 : lo;
+		hi = 0xF4 == ch ? 0x8F : hi;
+	}
+	else {
+		return 0;
+	}
+
+	if (pos + need >= len) {
+		return 0;
+	}
+	if (buf[pos + 1] < lo || buf[pos + 1] > hi) {
+		return 0;
+	}
+	for (size_t i = 2; i <= need; i += 1) {
+		if (0x80 != (buf[pos + i] & 0xC0)) {
+			return 0;
+		}
+	}
+
+	return need + 1;
+}
+
+#ifdef TOML2_VEC_SHUFFLE
+// This is the lookup-table validator from Keiser & Lemire, "Validating
+// UTF-8 In Less Than One Instruction Per Byte". Each byte is classified by
+// the high and low nibbles of the byte before it and the high nibble of the
+// byte itself; the three lookups are ANDed so that only combinations that
+// are errors in all three survive. Sequences longer than two bytes are then
+// checked by making sure continuation bytes show up exactly where a 3/4
+// byte lead says they should.
+#	define TOML2_UTF8_TOO_SHORT  (1 << 0)
+#	define TOML2_UTF8_TOO_LONG   (1 << 1)
+#	define TOML2_UTF8_OVERLONG_3 (1 << 2)
+#	define TOML2_UTF8_TOO_LARGE  (1 << 3)
+#	define TOML2_UTF8_SURROGATE  (1 << 4)
+#	define TOML2_UTF8_OVERLONG_2 (1 << 5)
+#	define TOML2_UTF8_TOO_LARGE_1000 (1 << 6)
+#	define TOML2_UTF8_OVERLONG_4 (1 << 6)
+#	define TOML2_UTF8_TWO_CONTS  (1 << 7)
+#	define TOML2_UTF8_CARRY \
+		(TOML2_UTF8_TOO_SHORT | TOML2_UTF8_TOO_LONG | TOML2_UTF8_TWO_CONTS)
+
+static const uint8_t toml2_utf8_byte1_high[16] = {
+	// 0_______ ________ <ASCII in byte 1>
+	TOML2_UTF8_TOO_LONG, TOML2_UTF8_TOO_LONG,
+	TOML2_UTF8_TOO_LONG, TOML2_UTF8_TOO_LONG,
+	TOML2_UTF8_TOO_LONG, TOML2_UTF8_TOO_LONG,
+	TOML2_UTF8_TOO_LONG, TOML2_UTF8_TOO_LONG,
+	// 10______ ________ <continuation in byte 1>
+	TOML2_UTF8_TWO_CONTS, TOML2_UTF8_TWO_CONTS,
+	TOML2_UTF8_TWO_CONTS, TOML2_UTF8_TWO_CONTS,
+	// 1100____ ________ <two byte lead in byte 1>
+	TOML2_UTF8_TOO_SHORT | TOML2_UTF8_OVERLONG_2,
+	// 1101____ ________ <two byte lead in byte 1>
+	TOML2_UTF8_TOO_SHORT,
+	// 1110____ ________ <three byte lead in byte 1>
+	TOML2_UTF8_TOO_SHORT | TOML2_UTF8_OVERLONG_3 | TOML2_UTF8_SURROGATE,
+	// 1111____ ________ <four+ byte lead in byte 1>
+	TOML2_UTF8_TOO_SHORT | TOML2_UTF8_TOO_LARGE
+		| TOML2_UTF8_TOO_LARGE_1000 | TOML2_UTF8_OVERLONG_4,
+};
+
+static const uint8_t toml2_utf8_byte1_low[16] = {
+	// ____0000 ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_OVERLONG_3
+		| TOML2_UTF8_OVERLONG_2 | TOML2_UTF8_OVERLONG_4,
+	// ____0001 ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_OVERLONG_2,
+	// ____001_ ________
+	TOML2_UTF8_CARRY,
+	TOML2_UTF8_CARRY,
+	// ____0100 ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE,
+	// ____0101 ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	// ____011_ ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	// ____1___ ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	// ____1101 ________
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000
+		| TOML2_UTF8_SURROGATE,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+	TOML2_UTF8_CARRY | TOML2_UTF8_TOO_LARGE | TOML2_UTF8_TOO_LARGE_1000,
+};
+
+static const uint8_t toml2_utf8_byte2_high[16] = {
+	// ________ 0_______ <ASCII in byte 2>
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+	// ________ 1000____
+	TOML2_UTF8_TOO_LONG | TOML2_UTF8_OVERLONG_2 | TOML2_UTF8_TWO_CONTS
+		| TOML2_UTF8_OVERLONG_3 | TOML2_UTF8_TOO_LARGE_1000
+		| TOML2_UTF8_OVERLONG_4,
+	// ________ 1001____
+	TOML2_UTF8_TOO_LONG | TOML2_UTF8_OVERLONG_2 | TOML2_UTF8_TWO_CONTS
+		| TOML2_UTF8_OVERLONG_3 | TOML2_UTF8_TOO_LARGE,
+	// ________ 101_____
+	TOML2_UTF8_TOO_LONG | TOML2_UTF8_OVERLONG_2 | TOML2_UTF8_TWO_CONTS
+		| TOML2_UTF8_SURROGATE | TOML2_UTF8_TOO_LARGE,
+	TOML2_UTF8_TOO_LONG | TOML2_UTF8_OVERLONG_2 | TOML2_UTF8_TWO_CONTS
+		| TOML2_UTF8_SURROGATE | TOML2_UTF8_TOO_LARGE,
+	// ________ 11______
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+	TOML2_UTF8_TOO_SHORT, TOML2_UTF8_TOO_SHORT,
+};
+
+// toml2_utf8_block returns a non-zero vector if in (preceded by prev) has
+// any encoding errors in it. A sequence cut off at the end of in isn't an
+// error here; see toml2_utf8_incomplete.
+static inline toml2_vec_t
+toml2_utf8_block(toml2_vec_t in, toml2_vec_t prev)
+{
+	const toml2_vec_t nibble = toml2_vec_set1(0x0F);
+	toml2_vec_t prev1 = toml2_vec_prev(in, prev, 1);
+	toml2_vec_t prev2 = toml2_vec_prev(in, prev, 2);
+	toml2_vec_t prev3 = toml2_vec_prev(in, prev, 3);
+
+	toml2_vec_t special = toml2_vec_and(
+		toml2_vec_and(
+			toml2_vec_lookup(
+				toml2_vec_table(toml2_utf8_byte1_high),
+				toml2_vec_and(toml2_vec_shr4(prev1), nibble)
+			),
+			toml2_vec_lookup(
+				toml2_vec_table(toml2_utf8_byte1_low),
+				toml2_vec_and(prev1, nibble)
+			)
+		),
+		toml2_vec_lookup(
+			toml2_vec_table(toml2_utf8_byte2_high),
+			toml2_vec_and(toml2_vec_shr4(in), nibble)
+		)
+	);
+
+	// Bytes two back from a 3/4-byte lead or three back from a 4-byte lead
+	// must be continuations; everything else already got TWO_CONTS above.
+	toml2_vec_t must_cont = toml2_vec_and(
+		toml2_vec_or(
+			toml2_vec_subs(prev2, toml2_vec_set1(0xE0 - 0x80)),
+			toml2_vec_subs(prev3, toml2_vec_set1(0xF0 - 0x80))
+		),
+		toml2_vec_set1(0x80)
+	);
+
+	return toml2_vec_xor(must_cont, special);
+}
+
+// toml2_utf8_incomplete returns a non-zero vector if in ends with the start
+// of a sequence that continues into the next block.
+static inline toml2_vec_t
+toml2_utf8_incomplete(toml2_vec_t in)
+{
+	// Only the last TOML2_VEC_LEN bytes of this are used.
+	static const uint8_t max[32] = {
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+	};
+
+	return toml2_vec_subs(in, toml2_vec_load((const char*) max + 32 - TOML2_VEC_LEN));
+}
+#endif
+
+size_t
+toml2_scan_utf8(const char *buf, size_t len)
+{
+	const uint8_t *b = (const uint8_t*) buf;
+	size_t pos = 0;
+
+#if defined(TOML2_VEC_SHUFFLE)
+	toml2_vec_t prev = toml2_vec_zero();
+	toml2_vec_t incomplete = toml2_vec_zero();
+
+	for (; pos + TOML2_VEC_LEN <= len; pos += TOML2_VEC_LEN) {
+		toml2_vec_t in = toml2_vec_load(buf + pos);
+		toml2_vec_t err;
+
+		// All-ASCII blocks are only wrong if the last one left a sequence
+		// hanging; the bulk of any real config takes this path.
+		if (0 == toml2_vec_high(in)) {
+			err = incomplete;
+			incomplete = toml2_vec_zero();
+		}
+		else {
+			err = toml2_utf8_block(in, prev);
+			incomplete = toml2_utf8_incomplete(in);
+		}
+
+		if (toml2_vec_any(err)) {
+			break;
+		}
+
+		prev = in;
+	}
+#elif defined(TOML2_VEC_LEN)
+	while (pos + TOML2_VEC_LEN <= len) {
+		if (0 == toml2_vec_high(toml2_vec_load(buf + pos))) {
+			pos += TOML2_VEC_LEN;
+			continue;
+		}
+
+		size_t end = pos + TOML2_VEC_LEN;
+		while (pos < end) {
+			size_t n = toml2_utf8_seq(b, len, pos);
+			if (0 == n) {
+				return pos;
+			}
+			pos += n;
+		}
+	}
+#endif
+
+	// Whatever's left -- the tail, or the block the vector check flagged --
+	// is done a sequence at a time. If a sequence straddles pos, back up to
+	// its lead byte so the reported offset is the first bad byte.
+	for (size_t back = 1; back <= 3 && back <= pos; back += 1) {
+		uint8_t ch = b[pos - back];
+		if (0x80 == (ch & 0xC0)) {
+			continue;
+		}
+
+		size_t seq = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : ch >= 0xC0 ? 2 : 1;
+		if (seq > back) {
+			pos -= back;
+		}
+		break;
+	}
+
+	while (pos < len) {
+		size_t n = toml2_utf8_seq(b, len, pos);
+		if (0 == n) {
+			return pos;
+		}
+		pos += n;
+	}
+
+	return len;
+}
+
+#ifndef TOML2_VEC_LEN
+// toml2_scan_marks_bit builds the scalar version of each mask, for targets
+// without a vector unit.
+static inline void
+toml2_scan_marks_bit(toml2_scan_marks_t *marks, char ch, uint64_t bit)
+{
+	switch (ch) {
+		case '[': case ']': case '{': case '}': case '=': case ',': case '.':
+			marks->punct |= bit;
+			break;
+		case '"': marks->dquote |= bit; break;
+		case '\'': marks->squote |= bit; break;
+		case '\n': marks->newline |= bit; break;
+		case '#': marks->hash |= bit; break;
+		case '\\': marks->backslash |= bit; break;
+		case 0: marks->nul |= bit; break;
+		default: break;
+	}
+}
+#endif
+
+void
+toml2_scan_marks(const char *buf, toml2_scan_marks_t *marks)
+{
+	*marks = (toml2_scan_marks_t) { 0 };
+
+#ifdef TOML2_VEC_LEN
+	for (size_t pos = 0; pos < 64; pos += TOML2_VEC_LEN) {
+		toml2_vec_t v = toml2_vec_load(buf + pos);
+		uint32_t punct = toml2_vec_eq(v, '[')
+			| toml2_vec_eq(v, ']')
+			| toml2_vec_eq(v, '{')
+			| toml2_vec_eq(v, '}')
+			| toml2_vec_eq(v, '=')
+			| toml2_vec_eq(v, ',')
+			| toml2_vec_eq(v, '.');
+
+		marks->punct |= (uint64_t) punct << pos;
+		marks->dquote |= (uint64_t) toml2_vec_eq(v, '"') << pos;
+		marks->squote |= (uint64_t) toml2_vec_eq(v, '\'') << pos;
+		marks->newline |= (uint64_t) toml2_vec_eq(v, '\n') << pos;
+		marks->hash |= (uint64_t) toml2_vec_eq(v, '#') << pos;
+		marks->backslash |= (uint64_t) toml2_vec_eq(v, '\\') << pos;
+		marks->nul |= (uint64_t) toml2_vec_eq(v, 0) << pos;
+	}
+#else
+	for (size_t pos = 0; pos < 64; pos += 1) {
+		toml2_scan_marks_bit(marks, buf[pos], (uint64_t) 1 << pos);
+	}
+#endif
+}
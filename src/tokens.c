@@ -0,0 +1,163 @@
+#include "toml2.h"
+#include "toml2-lexer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// toml2_tokens_grow makes room for one more element in the array at *data,
+// which holds *len of *cap elements of size bytes.
+static int
+toml2_tokens_grow(void **data, size_t *len, size_t *cap, size_t size)
+{
+	if (*len < *cap) {
+		return 0;
+	}
+
+	size_t new_cap = 0 == *cap ? 64 : *cap * 2;
+	void *new_data = realloc(*data, new_cap * size);
+	if (NULL == new_data) {
+		return TOML2_NO_MEMORY;
+	}
+
+	*data = new_data;
+	*cap = new_cap;
+	return 0;
+}
+
+static int
+toml2_tokens_push(toml2_tokens_t *out, toml2_token_t *tok)
+{
+	if (
+		toml2_tokens_grow(
+			(void**) &out->toks,
+			&out->len,
+			&out->cap,
+			sizeof(*out->toks)
+		)
+	) {
+		return TOML2_NO_MEMORY;
+	}
+
+	toml2_tok_t *t = &out->toks[out->len];
+	t->type = tok->type;
+	t->escaped = tok->escaped;
+	t->start = (uint32_t) tok->start;
+	t->len = (uint32_t) (tok->end - tok->start);
+	t->val = 0;
+
+	if (TOML2_TOKEN_INT == tok->type || TOML2_TOKEN_DOUBLE == tok->type) {
+		if (
+			toml2_tokens_grow(
+				(void**) &out->nums,
+				&out->nums_len,
+				&out->nums_cap,
+				sizeof(*out->nums)
+			)
+		) {
+			return TOML2_NO_MEMORY;
+		}
+
+		if (TOML2_TOKEN_INT == tok->type) {
+			out->nums[out->nums_len].ival = tok->ival;
+		}
+		else {
+			out->nums[out->nums_len].fval = tok->fval;
+		}
+
+		t->val = (uint32_t) out->nums_len;
+		out->nums_len += 1;
+	}
+	else if (TOML2_TOKEN_DATE == tok->type) {
+		if (
+			toml2_tokens_grow(
+				(void**) &out->dates,
+				&out->dates_len,
+				&out->dates_cap,
+				sizeof(*out->dates)
+			)
+		) {
+			return TOML2_NO_MEMORY;
+		}
+
+		toml2_tok_date_t *d = &out->dates[out->dates_len];
+		d->nsec = tok->time_nsec;
+		d->offset = tok->time_offset;
+		d->year = (int16_t) tok->time.tm_year;
+		d->mon = (int8_t) tok->time.tm_mon;
+		d->mday = (uint8_t) tok->time.tm_mday;
+		d->hour = (uint8_t) tok->time.tm_hour;
+		d->min = (uint8_t) tok->time.tm_min;
+		d->sec = (uint8_t) tok->time.tm_sec;
+
+		t->val = (uint32_t) out->dates_len;
+		out->dates_len += 1;
+	}
+
+	out->len += 1;
+	return 0;
+}
+
+int
+toml2_lex_all(toml2_lex_t *lex, toml2_tokens_t *out)
+{
+	int ret;
+
+	if (lex->buf_len > UINT32_MAX) {
+		return lex->err.err = TOML2_INTERNAL_ERROR;
+	}
+
+	toml2_token_t tok;
+
+	do {
+		if (0 != (ret = toml2_lex_token(lex, &tok))) {
+			return ret;
+		}
+		if (0 != toml2_tokens_push(out, &tok)) {
+			return lex->err.err = TOML2_NO_MEMORY;
+		}
+	}
+	while (TOML2_TOKEN_EOF != tok.type);
+
+	return 0;
+}
+
+void
+toml2_tokens_get(const toml2_tokens_t *toks, size_t idx, toml2_token_t *tok)
+{
+	const toml2_tok_t *t = &toks->toks[idx];
+
+	tok->type = t->type;
+	tok->escaped = t->escaped;
+	tok->start = t->start;
+	tok->end = t->start + t->len;
+
+	if (TOML2_TOKEN_INT == t->type) {
+		tok->ival = toks->nums[t->val].ival;
+	}
+	else if (TOML2_TOKEN_DOUBLE == t->type) {
+		tok->fval = toks->nums[t->val].fval;
+	}
+	else if (TOML2_TOKEN_DATE == t->type) {
+		const toml2_tok_date_t *d = &toks->dates[t->val];
+
+		bzero(&tok->time, sizeof(tok->time));
+		tok->time.tm_year = d->year;
+		tok->time.tm_mon = d->mon;
+		tok->time.tm_mday = d->mday;
+		tok->time.tm_hour = d->hour;
+		tok->time.tm_min = d->min;
+		tok->time.tm_sec = d->sec;
+		tok->time.tm_gmtoff = d->offset;
+		tok->time_nsec = d->nsec;
+		tok->time_offset = d->offset;
+	}
+}
+
+void
+toml2_tokens_free(toml2_tokens_t *toks)
+{
+	free(toks->toks);
+	free(toks->nums);
+	free(toks->dates);
+	bzero(toks, sizeof(*toks));
+}
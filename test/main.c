@@ -5,12 +5,14 @@ typedef Suite*(*suite_def)();
 extern Suite 
 	*suite_lexer(),
 	*suite_grammar(),
-	*suite_exports();
+	*suite_exports(),
+	*suite_scan();
 
 static suite_def suites[] = {
 	&suite_lexer,
 	&suite_grammar,
 	&suite_exports,
+	&suite_scan,
 };
 
 int
@@ -126,6 +126,261 @@ START_TEST(diorite)
 }
 END_TEST
 
+START_TEST(zero_copy)
+{
+	const char *str = "[\"a\\tb\"]\nc = \"plain\"\nd = 'lit'\ne = \"x\\ny\"";
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(
+		0,
+		toml2_parse_flags(&doc, str, strlen(str), TOML2_ZERO_COPY)
+	);
+
+	// Escape-free strings and names point into the input...
+	toml2_t *c = toml2_get_path(&doc, "a\tb.c");
+	ck_assert_ptr_ne(NULL, c);
+	ck_assert_ptr_eq(strstr(str, "plain"), toml2_string(c));
+	ck_assert_int_eq(5, toml2_string_len(c));
+	ck_assert_ptr_eq(strstr(str, "c ="), toml2_name(c));
+	ck_assert_int_eq(1, toml2_name_len(c));
+
+	toml2_t *d = toml2_get_path(&doc, "a\tb.d");
+	ck_assert_ptr_eq(strstr(str, "lit"), toml2_string(d));
+	ck_assert_int_eq(3, toml2_string_len(d));
+
+	// ...and the rest are decoded copies.
+	toml2_t *ab = toml2_get(&doc, "a\tb");
+	ck_assert_int_eq(3, toml2_name_len(ab));
+	ck_assert_str_eq("a\tb", toml2_name(ab));
+
+	toml2_t *e = toml2_get_path(&doc, "a\tb.e");
+	ck_assert_int_eq(3, toml2_string_len(e));
+	ck_assert_str_eq("x\ny", toml2_string(e));
+
+	toml2_free(&doc);
+}
+END_TEST
+
+static const char *lazy_str =
+	"a = \"x\\ty\"\nb = 'lit'\nc = 1.5e3\nd = 7\ne = [0.25]\nf = [\"\\u00e9\"]";
+
+// check_lazy checks the values of lazy_str, parsed into doc with TOML2_LAZY.
+static void
+check_lazy(toml2_t *doc)
+{
+	// Decoding is only done once.
+	toml2_t *a = toml2_get(doc, "a");
+	ck_assert_int_eq(TOML2_STRING, toml2_type(a));
+	ck_assert_int_eq(3, toml2_string_len(a));
+	ck_assert_str_eq("x\ty", toml2_string(a));
+	ck_assert_ptr_eq(toml2_string(a), toml2_string(a));
+
+	ck_assert_int_eq(TOML2_FLOAT, toml2_type(toml2_get(doc, "c")));
+	ck_assert_int_eq(1500, toml2_int(toml2_get(doc, "c")));
+	ck_assert(1500. == toml2_float(toml2_get(doc, "c")));
+	ck_assert_int_eq(7, toml2_int(toml2_get(doc, "d")));
+	ck_assert(0.25 == toml2_float(toml2_get_path(doc, "e.0")));
+	ck_assert_str_eq("\xc3\xa9", toml2_string(toml2_get_path(doc, "f.0")));
+}
+
+START_TEST(lazy)
+{
+	int flags[] = { TOML2_LAZY, TOML2_LAZY | TOML2_ARENA };
+	for (size_t i = 0; i < sizeof(flags) / sizeof(*flags); i += 1) {
+		toml2_t doc = check_init_flags(lazy_str, strlen(lazy_str), flags[i]);
+		check_lazy(&doc);
+
+		// Escape-free strings are views into the buffer.
+		ck_assert_ptr_eq(
+			strstr(lazy_str, "lit"),
+			toml2_string(toml2_get(&doc, "b"))
+		);
+		toml2_free(&doc);
+	}
+}
+END_TEST
+
+START_TEST(lazy_freeze)
+{
+	char *buf = strdup(lazy_str);
+	toml2_t doc = check_init_flags(buf, strlen(buf), TOML2_LAZY);
+
+	// Freezing decodes everything, so the buffer can go.
+	ck_assert_int_eq(0, toml2_freeze(&doc));
+	memset(buf, 0, strlen(buf));
+	free(buf);
+
+	check_lazy(&doc);
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(freeze)
+{
+	char str[1024];
+	size_t len = sprintf(str, "x = [[1, 2], [\"s\"]]\n[t]\n");
+	for (int i = 0; i < 40; i += 1) {
+		len += sprintf(str + len, "k%02d = { v = %d }\n", 39 - i, 39 - i);
+	}
+
+	int flags[] = { 0, TOML2_ZERO_COPY, TOML2_ARENA, TOML2_HASH_TABLES };
+	for (size_t f = 0; f < sizeof(flags) / sizeof(*flags); f += 1) {
+		char *buf = strdup(str);
+		toml2_t doc = check_init_flags(buf, len, flags[f]);
+		ck_assert_int_eq(0, toml2_freeze(&doc));
+		ck_assert_int_eq(0, toml2_freeze(&doc));
+
+		// The frozen document doesn't need the buffer any more.
+		memset(buf, 0, len);
+		free(buf);
+
+		toml2_t *t = toml2_get(&doc, "t");
+		ck_assert_int_eq(40, toml2_len(t));
+		for (int i = 0; i < 40; i += 1) {
+			char key[8];
+			sprintf(key, "k%02d", i);
+			ck_assert_int_eq(i, toml2_int(toml2_get(toml2_get(t, key), "v")));
+		}
+		ck_assert_str_eq("k00", toml2_name(toml2_index(t, 0)));
+		ck_assert_ptr_eq(NULL, toml2_get(t, "k40"));
+		ck_assert_ptr_eq(NULL, toml2_get(t, ""));
+
+		toml2_iter_t iter;
+		ck_assert_int_eq(0, toml2_iter_init(&iter, t));
+		for (size_t i = 0; i < 40; i += 1) {
+			toml2_t *sub = toml2_iter_next(&iter);
+			ck_assert_ptr_eq(toml2_index(t, i), sub);
+			ck_assert_int_eq(i, toml2_int(toml2_get(sub, "v")));
+		}
+		ck_assert_ptr_eq(NULL, toml2_iter_next(&iter));
+		toml2_iter_free(&iter);
+
+		ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "x.0.1")));
+		ck_assert_str_eq("s", toml2_string(toml2_get_path(&doc, "x.1.0")));
+		toml2_free(&doc);
+	}
+}
+END_TEST
+
+static const char *doc_order_str =
+	"z = 1\nb = 2\n[m]\ny = 3\nx = [4]\n[a]\n";
+
+// check_doc_order checks the order of the keys of doc_order_str, parsed
+// into doc.
+static void
+check_doc_order(toml2_t *doc)
+{
+	const char *doc_order = "zbma", *sorted = "abmz";
+
+	ck_assert_int_eq(4, toml2_len(doc));
+	for (size_t i = 0; i < 4; i += 1) {
+		ck_assert_int_eq(doc_order[i], toml2_name(toml2_index_doc_order(doc, i))[0]);
+		ck_assert_int_eq(sorted[i], toml2_name(toml2_index(doc, i))[0]);
+	}
+	ck_assert_ptr_eq(NULL, toml2_index_doc_order(doc, 4));
+
+	toml2_t *m = toml2_get(doc, "m");
+	ck_assert_int_eq('y', toml2_name(toml2_index_doc_order(m, 0))[0]);
+	ck_assert_int_eq('x', toml2_name(toml2_index(m, 0))[0]);
+	ck_assert_int_eq(4, toml2_int(toml2_index_doc_order(toml2_get(m, "x"), 0)));
+}
+
+START_TEST(doc_order)
+{
+	const char *str = doc_order_str;
+	int flags[] = { 0, TOML2_ZERO_COPY, TOML2_ARENA, TOML2_EXACT_SIZE };
+
+	for (size_t f = 0; f < sizeof(flags) / sizeof(*flags); f += 1) {
+		toml2_t doc = check_init_flags(str, strlen(str), flags[f]);
+		check_doc_order(&doc);
+		toml2_free(&doc);
+	}
+}
+END_TEST
+
+START_TEST(doc_order_frozen)
+{
+	toml2_t doc = check_init(doc_order_str);
+	ck_assert_int_eq(0, toml2_freeze(&doc));
+	check_doc_order(&doc);
+	toml2_free(&doc);
+}
+END_TEST
+
+// write_temp writes str to a new temporary file, returning its path in path.
+static void
+write_temp(char *path, const char *str)
+{
+	int fd = mkstemp(path);
+	ck_assert_int_ne(-1, fd);
+	ck_assert_int_eq(strlen(str), write(fd, str, strlen(str)));
+	close(fd);
+}
+
+START_TEST(parse_file)
+{
+	char path[] = "/tmp/toml2-test.XXXXXX";
+	write_temp(path, "[t]\nkey = \"value\"");
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_file(&doc, path, TOML2_ZERO_COPY));
+
+	// The mapping outlives the file with TOML2_ZERO_COPY.
+	unlink(path);
+	toml2_t *key = toml2_get_path(&doc, "t.key");
+	ck_assert_int_eq(5, toml2_string_len(key));
+	ck_assert(0 == memcmp("value", toml2_string(key), 5));
+	toml2_free(&doc);
+
+	char empty[] = "/tmp/toml2-test.XXXXXX";
+	write_temp(empty, "");
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_file(&doc, empty, 0));
+	ck_assert_int_eq(0, toml2_len(&doc));
+	toml2_free(&doc);
+	unlink(empty);
+}
+END_TEST
+
+START_TEST(parse_fd_pipe)
+{
+	const char *str = "a = [1, 2]\nb = 'x'";
+	int fds[2];
+	ck_assert_int_eq(0, pipe(fds));
+	ck_assert_int_eq(strlen(str), write(fds[1], str, strlen(str)));
+	close(fds[1]);
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_fd(&doc, fds[0], TOML2_ZERO_COPY));
+	ck_assert_int_eq(2, toml2_len(toml2_get(&doc, "a")));
+	ck_assert_str_eq("x", toml2_string(toml2_get(&doc, "b")));
+	toml2_free(&doc);
+	close(fds[0]);
+}
+END_TEST
+
+START_TEST(err_parse_file)
+{
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(TOML2_ERRNO, toml2_parse_file(&doc, "/nonexistent/x", 0));
+	ck_assert_int_eq(ENOENT, errno);
+	ck_assert_int_eq(TOML2_ERRNO, toml2_last_error(&doc).err);
+	ck_assert_int_eq(ENOENT, toml2_last_error(&doc).code);
+	toml2_free(&doc);
+
+	char path[] = "/tmp/toml2-test.XXXXXX";
+	write_temp(path, "a = ");
+	toml2_init(&doc);
+	ck_assert_int_eq(TOML2_PARSE_ERROR, toml2_parse_file(&doc, path, 0));
+	ck_assert_int_eq(1, toml2_last_error(&doc).line);
+	toml2_free(&doc);
+	unlink(path);
+}
+END_TEST
+
 Suite*
 suite_exports()
 {
@@ -136,6 +391,15 @@ suite_exports()
 		{ "iter_empty_table", &iter_empty_table },
 		{ "err_iter_int",     &err_iter_int     },
 		{ "diorite",          &diorite          },
+		{ "zero_copy",        &zero_copy        },
+		{ "lazy",             &lazy             },
+		{ "lazy_freeze",      &lazy_freeze      },
+		{ "freeze",           &freeze           },
+		{ "doc_order",        &doc_order        },
+		{ "doc_order_frozen", &doc_order_frozen },
+		{ "parse_file",       &parse_file       },
+		{ "parse_fd_pipe",    &parse_fd_pipe    },
+		{ "err_parse_file",   &err_parse_file   },
 	};
 
 	return tcase_build_suite("exports", tests, sizeof(tests));
@@ -1,5 +1,6 @@
 #include "util.h"
 #include "toml2.h"
+#include "toml2-grammar.h"
 
 static toml2_t
 check_init(const char *str)
@@ -215,6 +216,116 @@ START_TEST(err_dupe_itable2)
 }
 END_TEST
 
+START_TEST(err_first_error)
+{
+	// The grammar error at the '.' comes before the unclosed string, so
+	// it's the one reported.
+	check_err(TOML2_PARSE_ERROR, "\"a-string\".must-be = \"closed");
+}
+END_TEST
+
+START_TEST(err_position)
+{
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(TOML2_INVALID_UTF8, toml2_parse(&doc, "a = \"\xff\"", 8));
+	toml2_err_t err = toml2_last_error(&doc);
+	ck_assert_int_eq(TOML2_INVALID_UTF8, err.err);
+	ck_assert_int_eq(1, err.line);
+	ck_assert_int_eq(6, err.col);
+	toml2_free(&doc);
+
+	toml2_init(&doc);
+	const char *str = "[a]\nb = 1\n\n[a]\n";
+	ck_assert_int_eq(TOML2_TABLE_REASSIGNED, toml2_parse(&doc, str, strlen(str)));
+	err = toml2_last_error(&doc);
+	ck_assert_int_eq(TOML2_TABLE_REASSIGNED, err.err);
+	ck_assert_int_eq(4, err.line);
+	toml2_free(&doc);
+
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_feed(&doc, "a = 1\nb = ", 10));
+	ck_assert_int_eq(TOML2_PARSE_ERROR, toml2_parse_feed(&doc, "1\nc = ]\n", 8));
+	err = toml2_last_error(&doc);
+	ck_assert_int_eq(TOML2_PARSE_ERROR, err.err);
+	ck_assert_int_eq(3, err.line);
+	ck_assert_int_eq(5, err.col);
+	toml2_free(&doc);
+
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse(&doc, "a = 1\n", 6));
+	ck_assert_int_eq(TOML2_NO_ERROR, toml2_last_error(&doc).err);
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(parse_tokens)
+{
+	const char *str =
+		"# comment\n"
+		"[a]\n"
+		"s = \"x\\ty\" # trailing\n"
+		"f = 0.25\n"
+		"d = 1987-07-05T17:45:00.5-07:00\n"
+		"l = [1, 2, 3]\n";
+	toml2_lex_t lex;
+	toml2_tokens_t toks = { 0 };
+	ck_assert_int_eq(0, toml2_lex_init(&lex, str, strlen(str)));
+	ck_assert_int_eq(0, toml2_lex_all(&lex, &toks));
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_tokens(&doc, str, strlen(str), &toks));
+	ck_assert_str_eq("x\ty", toml2_string(toml2_get_path(&doc, "a.s")));
+	ck_assert(0.25 == toml2_float(toml2_get_path(&doc, "a.f")));
+	toml2_t *d = toml2_get_path(&doc, "a.d");
+	ck_assert_int_eq(17, toml2_date(d).tm_hour);
+	ck_assert_int_eq(500000000, toml2_date_nsec(d));
+	ck_assert_int_eq(-7 * 60 * 60, toml2_date_offset(d));
+	ck_assert_int_eq(3, toml2_int(toml2_get_path(&doc, "a.l.2")));
+	toml2_free(&doc);
+
+	// Running out of tokens before TOML2_TOKEN_EOF is an error.
+	toks.len -= 1;
+	toml2_init(&doc);
+	ck_assert_int_eq(
+		TOML2_PARSE_ERROR,
+		toml2_parse_tokens(&doc, str, strlen(str), &toks)
+	);
+	toml2_free(&doc);
+
+	toml2_tokens_free(&toks);
+	toml2_lex_free(&lex);
+}
+END_TEST
+
+// invalid_at is the token that invalidate_token, as toml2_parse_hook, turns
+// into TOML2_TOKEN_INVALID; invalid_seen counts the tokens seen so far.
+static size_t invalid_at, invalid_seen;
+
+static void
+invalidate_token(toml2_token_t *tok)
+{
+	if (invalid_seen == invalid_at) {
+		tok->type = TOML2_TOKEN_INVALID;
+	}
+	invalid_seen += 1;
+}
+
+START_TEST(err_invalid_token)
+{
+	// No mode has a transition for TOML2_TOKEN_INVALID, at the start of a
+	// line or anywhere else.
+	toml2_parse_hook = &invalidate_token;
+	for (invalid_at = 0; invalid_at < 5; invalid_at += 1) {
+		invalid_seen = 0;
+		check_err(TOML2_PARSE_ERROR, "x = 1\n");
+		ck_assert(invalid_at < invalid_seen);
+	}
+	toml2_parse_hook = NULL;
+}
+END_TEST
+
 START_TEST(sub_empty2)
 {
 	toml2_t doc = check_init("[a.b.c]\n[a]\n");
@@ -235,6 +346,18 @@ START_TEST(datetime)
 }
 END_TEST
 
+START_TEST(datetime_nsec_offset)
+{
+	toml2_t doc = check_init("date = 1987-07-05T17:45:00.5-07:00");
+	struct tm tm = toml2_date(toml2_get(&doc, "date"));
+	ck_assert_int_eq(1987, tm.tm_year);
+	ck_assert_int_eq(17, tm.tm_hour);
+	ck_assert_int_eq(500000000, toml2_date_nsec(toml2_get(&doc, "date")));
+	ck_assert_int_eq(-7 * 60 * 60, toml2_date_offset(toml2_get(&doc, "date")));
+	toml2_free(&doc);
+}
+END_TEST
+
 START_TEST(iarray_trail_comma)
 {
 	toml2_t doc = check_init("x = [1, 2,]");
@@ -367,6 +490,514 @@ START_TEST(numeric_key3)
 }
 END_TEST
 
+START_TEST(arena)
+{
+	const char *str =
+		"[\"t\\u0062l\"]\n"
+		"a = \"x\\ty\"\n"
+		"b = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]\n"
+		"[[c]]\n"
+		"d = { e = 'lit' }\n"
+		"[[c]]\n";
+	int flags[] = { TOML2_ARENA, TOML2_ARENA | TOML2_ZERO_COPY };
+
+	for (size_t i = 0; i < sizeof(flags) / sizeof(*flags); i += 1) {
+		toml2_t doc = check_init_flags(str, strlen(str), flags[i]);
+		ck_assert_int_eq(2, toml2_len(&doc));
+		ck_assert_int_eq(3, toml2_name_len(toml2_get(&doc, "tbl")));
+		ck_assert_str_eq("x\ty", toml2_string(toml2_get_path(&doc, "tbl.a")));
+		ck_assert_int_eq(10, toml2_len(toml2_get_path(&doc, "tbl.b")));
+		ck_assert_int_eq(10, toml2_int(toml2_get_path(&doc, "tbl.b.9")));
+		ck_assert_int_eq(2, toml2_len(toml2_get(&doc, "c")));
+		ck_assert_int_eq(3, toml2_string_len(toml2_get_path(&doc, "c.0.d.e")));
+		toml2_free(&doc);
+	}
+
+	toml2_t doc;
+	toml2_init(&doc);
+	str = "a = 1\na = 2";
+	ck_assert_int_ne(0, toml2_parse_flags(&doc, str, strlen(str), TOML2_ARENA));
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(exact_size)
+{
+	const char *str =
+		"[\"t\\u0062l\"]\n"
+		"a = \"x\\ty\"\n"
+		"b = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]\n"
+		"e = []\n"
+		"[[c]]\n"
+		"d = { e = 'lit', f = [[\"g\"], []] }\n"
+		"[[c]]\n";
+	int flags[] = { TOML2_EXACT_SIZE, TOML2_EXACT_SIZE | TOML2_ZERO_COPY };
+
+	for (size_t i = 0; i < sizeof(flags) / sizeof(*flags); i += 1) {
+		toml2_t doc = check_init_flags(str, strlen(str), flags[i]);
+		ck_assert_int_eq(0, doc.root->arena.left);
+		ck_assert_int_eq(2, toml2_len(&doc));
+		ck_assert_str_eq("x\ty", toml2_string(toml2_get_path(&doc, "tbl.a")));
+		ck_assert_int_eq(10, toml2_len(toml2_get_path(&doc, "tbl.b")));
+		ck_assert_int_eq(10, toml2_get_path(&doc, "tbl.b")->ary_cap);
+		ck_assert_int_eq(10, toml2_int(toml2_get_path(&doc, "tbl.b.9")));
+		ck_assert_int_eq(0, toml2_len(toml2_get_path(&doc, "tbl.e")));
+		ck_assert_int_eq(2, toml2_len(toml2_get(&doc, "c")));
+		ck_assert_int_eq(3, toml2_string_len(toml2_get_path(&doc, "c.0.d.e")));
+		ck_assert_int_eq(1, toml2_string_len(toml2_get_path(&doc, "c.0.d.f.0.0")));
+		ck_assert_ptr_eq(NULL, toml2_get_path(&doc, "c.1.d"));
+		toml2_free(&doc);
+	}
+
+	toml2_t doc = check_init_flags("", 0, TOML2_EXACT_SIZE);
+	ck_assert_int_eq(0, toml2_len(&doc));
+	toml2_free(&doc);
+
+	toml2_init(&doc);
+	str = "a = 1\na = 2";
+	ck_assert_int_ne(0, toml2_parse_flags(&doc, str, strlen(str), TOML2_EXACT_SIZE));
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(shared_keys)
+{
+	const char *str =
+		"[[s]]\n"
+		"a = 1\n"
+		"\"k\\u0065y\" = 2\n"
+		"[[s]]\n"
+		"a = 3\n"
+		"key = 4\n";
+	int flags[] = { 0, TOML2_ZERO_COPY, TOML2_ARENA, TOML2_EXACT_SIZE };
+
+	for (size_t i = 0; i < sizeof(flags) / sizeof(*flags); i += 1) {
+		toml2_t doc = check_init_flags(str, strlen(str), flags[i]);
+
+		toml2_t *a0 = toml2_get_path(&doc, "s.0.a");
+		toml2_t *a1 = toml2_get_path(&doc, "s.1.a");
+		toml2_t *k0 = toml2_get_path(&doc, "s.0.key");
+		toml2_t *k1 = toml2_get_path(&doc, "s.1.key");
+		ck_assert_int_eq(3, toml2_int(a1));
+		ck_assert_int_eq(4, toml2_int(k1));
+		ck_assert_int_eq(3, toml2_name_len(k0));
+		if (!(flags[i] & TOML2_ZERO_COPY)) {
+			ck_assert_ptr_eq(toml2_name(a0), toml2_name(a1));
+			ck_assert_ptr_eq(toml2_name(k0), toml2_name(k1));
+		}
+		toml2_free(&doc);
+	}
+}
+END_TEST
+
+START_TEST(hash_tables)
+{
+	char str[2048], key[8];
+	size_t len = 0;
+	for (int i = 0; i < 100; i += 1) {
+		len += sprintf(str + len, "k%02d = %d\n", 99 - i, 99 - i);
+	}
+	len += sprintf(str + len, "[t.\"\\u0075\"]\nv = 1\n");
+
+	int flags[] = {
+		TOML2_HASH_TABLES,
+		TOML2_HASH_TABLES | TOML2_ZERO_COPY,
+		TOML2_HASH_TABLES | TOML2_ARENA,
+		TOML2_HASH_TABLES | TOML2_EXACT_SIZE,
+	};
+
+	for (size_t i = 0; i < sizeof(flags) / sizeof(*flags); i += 1) {
+		toml2_t doc = check_init_flags(str, len, flags[i]);
+		ck_assert_int_eq(101, toml2_len(&doc));
+		for (int j = 0; j < 100; j += 1) {
+			sprintf(key, "k%02d", j);
+			ck_assert_int_eq(j, toml2_int(toml2_get(&doc, key)));
+		}
+		ck_assert_ptr_eq(NULL, toml2_get(&doc, "k100"));
+		ck_assert_ptr_eq(NULL, toml2_get(&doc, "k"));
+		ck_assert_int_eq(1, toml2_int(toml2_get_path(&doc, "t.u.v")));
+		ck_assert_int_eq(0, memcmp("k00", toml2_name(toml2_index(&doc, 0)), 3));
+		toml2_free(&doc);
+	}
+
+	toml2_t doc;
+	toml2_init(&doc);
+	const char *dupe = "a = 1\nb = 2\na = 3";
+	ck_assert_int_ne(0, toml2_parse_flags(&doc, dupe, strlen(dupe), TOML2_HASH_TABLES));
+	toml2_free(&doc);
+}
+END_TEST
+
+// check_feed parses str via toml2_parse_feed, chunk bytes at a time.
+static int
+check_feed(toml2_t *doc, const char *str, size_t chunk)
+{
+	size_t len = strlen(str);
+	toml2_init(doc);
+
+	for (size_t i = 0; i < len; i += chunk) {
+		size_t n = len - i < chunk ? len - i : chunk;
+		int ret = toml2_parse_feed(doc, str + i, n);
+		if (0 != ret) {
+			return ret;
+		}
+	}
+
+	return toml2_parse_finish(doc);
+}
+
+START_TEST(feed)
+{
+	const char *str =
+		"# comment\n"
+		"[tbl]\n"
+		"int = 123456789012\n"
+		"float = -1.5e-3\n"
+		"str = \"caf\xC3\xA9 \\u00e9\"\n"
+		"ml = \"\"\"\nline\nline\"\"\"\n"
+		"lit = 'x'\n"
+		"date = 1987-07-05T17:45:00.5-07:00\n"
+		"ary = [1, 2, 3]\n"
+		"[[list]]\n"
+		"x = true";
+
+	for (size_t chunk = 1; chunk <= strlen(str); chunk += 1) {
+		toml2_t doc;
+		ck_assert_int_eq(0, check_feed(&doc, str, chunk));
+		ck_assert_int_eq(123456789012, toml2_int(toml2_get_path(&doc, "tbl.int")));
+		ck_assert(-1.5e-3 == toml2_float(toml2_get_path(&doc, "tbl.float")));
+		ck_assert_str_eq("caf\xC3\xA9 \xC3\xA9", toml2_string(toml2_get_path(&doc, "tbl.str")));
+		ck_assert_str_eq("line\nline", toml2_string(toml2_get_path(&doc, "tbl.ml")));
+		ck_assert_str_eq("x", toml2_string(toml2_get_path(&doc, "tbl.lit")));
+		ck_assert_int_eq(500000000, toml2_date_nsec(toml2_get_path(&doc, "tbl.date")));
+		ck_assert_int_eq(3, toml2_len(toml2_get_path(&doc, "tbl.ary")));
+		ck_assert_int_eq(true, toml2_bool(toml2_get_path(&doc, "list.0.x")));
+		toml2_free(&doc);
+	}
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_finish(&doc));
+	ck_assert_int_eq(0, toml2_len(&doc));
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(err_feed)
+{
+	toml2_t doc;
+
+	ck_assert_int_ne(0, check_feed(&doc, "x = \"abc", 1));
+	toml2_free(&doc);
+	ck_assert_int_ne(0, check_feed(&doc, "x = \"abc\ny = 1", 1));
+	toml2_free(&doc);
+	ck_assert_int_ne(0, check_feed(&doc, "x = ", 2));
+	toml2_free(&doc);
+	ck_assert_int_ne(0, check_feed(&doc, "x = \"\xC3", 1));
+	toml2_free(&doc);
+	ck_assert_int_ne(0, check_feed(&doc, "x = \"\xC3\x28\"", 1));
+	toml2_free(&doc);
+
+	// Whole lines are parsed as soon as they arrive, since nothing more
+	// can change a newline.
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_feed(&doc, "x = 1000\n", 9));
+	ck_assert_int_ne(0, toml2_parse_feed(&doc, "x = 2\n", 6));
+	toml2_free(&doc);
+
+	// Errors stick once they've happened.
+	toml2_init(&doc);
+	ck_assert_int_ne(0, toml2_parse_feed(&doc, "x = 1\nx = 2\n", 12));
+	ck_assert_int_ne(0, toml2_parse_feed(&doc, "y = 1\n", 6));
+	ck_assert_int_ne(0, toml2_parse_finish(&doc));
+	toml2_free(&doc);
+}
+END_TEST
+
+// check_reparse replaces the first occurrence of at in the len bytes of buf
+// with with, and has toml2_reparse bring doc up to date.
+static int
+check_reparse(toml2_t *doc, char *buf, size_t *len, const char *at, const char *with)
+{
+	char *pos = strstr(buf, at);
+	ck_assert_ptr_ne(NULL, pos);
+
+	toml2_edit_t edit = {
+		.offset = pos - buf,
+		.old_len = strlen(at),
+		.new_len = strlen(with),
+	};
+	memmove(pos + edit.new_len, pos + edit.old_len, *len - edit.offset - edit.old_len + 1);
+	memcpy(pos, with, edit.new_len);
+	*len = *len - edit.old_len + edit.new_len;
+
+	return toml2_reparse(doc, buf, *len, &edit, 1);
+}
+
+START_TEST(reparse)
+{
+	char buf[256] =
+		"top = 1\n"
+		"[a]\n"
+		"x = 1\n"
+		"[b]\n"
+		"y = 2\n"
+		"[[c]]\n"
+		"z = 3\n"
+		"[[c]]\n"
+		"z = 4\n";
+	size_t len = strlen(buf);
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse(&doc, buf, len));
+	toml2_t *a = toml2_get(&doc, "a");
+
+	// Only b is parsed again.
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "y = 2", "y = 20"));
+	ck_assert_int_eq(20, toml2_int(toml2_get_path(&doc, "b.y")));
+	ck_assert_ptr_eq(a, toml2_get(&doc, "a"));
+	ck_assert_int_eq(4, toml2_int(toml2_get_path(&doc, "c.1.z")));
+
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "[[c]]", "[d]\nw = 5\n[[c]]"));
+	ck_assert_int_eq(5, toml2_len(&doc));
+	ck_assert_int_eq(5, toml2_int(toml2_get_path(&doc, "d.w")));
+	ck_assert_int_eq(2, toml2_len(toml2_get(&doc, "c")));
+	ck_assert_ptr_eq(a, toml2_get(&doc, "a"));
+
+	const char *order[] = { "top", "a", "b", "d", "c" };
+	for (size_t i = 0; i < 5; i += 1) {
+		ck_assert_str_eq(order[i], toml2_name(toml2_index_doc_order(&doc, i)));
+	}
+	ck_assert_str_eq("d", toml2_name(toml2_index(&doc, 3)));
+
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "[[c]]\nz = 4\n", ""));
+	ck_assert_int_eq(1, toml2_len(toml2_get(&doc, "c")));
+	ck_assert_int_eq(3, toml2_int(toml2_get_path(&doc, "c.0.z")));
+
+	// Edits to the root's own keys parse the whole document again.
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "top = 1", "top = 2"));
+	ck_assert_int_eq(2, toml2_int(toml2_get(&doc, "top")));
+	ck_assert_int_eq(5, toml2_int(toml2_get_path(&doc, "d.w")));
+
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "x = 1", "x = 1\ny = 2"));
+	ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "a.y")));
+	ck_assert_int_eq(20, toml2_int(toml2_get_path(&doc, "b.y")));
+	toml2_free(&doc);
+
+	// Documents that can't be updated in place are parsed from scratch.
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_flags(&doc, buf, len, TOML2_ARENA | TOML2_HASH_TABLES));
+	ck_assert_int_eq(0, check_reparse(&doc, buf, &len, "w = 5", "w = 6"));
+	ck_assert_int_eq(6, toml2_int(toml2_get_path(&doc, "d.w")));
+	ck_assert_ptr_ne(NULL, doc.root->arena.block);
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(reparse_keys)
+{
+	char buf[256] = "[a]\nk0 = 1\n[b]\nx = [{ y = 2 }]\n";
+	size_t len = strlen(buf);
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse(&doc, buf, len));
+
+	// Names the document no longer uses are dropped from the key table
+	// once they add up to more than the document.
+	char at[16], with[16];
+	for (int i = 0; i < 10000; i += 1) {
+		sprintf(at, "k%d =", i);
+		sprintf(with, "k%d =", i + 1);
+		ck_assert_int_eq(0, check_reparse(&doc, buf, &len, at, with));
+		ck_assert(doc.root->keys.len <= 16);
+	}
+
+	ck_assert_int_eq(1, toml2_int(toml2_get_path(&doc, "a.k10000")));
+	ck_assert_ptr_eq(NULL, toml2_get_path(&doc, "a.k9999"));
+	ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "b.x.0.y")));
+	toml2_free(&doc);
+}
+END_TEST
+
+START_TEST(err_reparse)
+{
+	char buf[64] = "[a]\nx = 1\n[b]\ny = 2\n";
+	size_t len = strlen(buf);
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse(&doc, buf, len));
+
+	// Edits past the end, or that don't add up to the new length, are
+	// rejected without touching doc.
+	toml2_edit_t past = { .offset = len + 1, .old_len = 0, .new_len = 0 };
+	errno = 0;
+	ck_assert_int_eq(TOML2_ERRNO, toml2_reparse(&doc, buf, len, &past, 1));
+	ck_assert_int_eq(EINVAL, errno);
+	toml2_edit_t grow = { .offset = 0, .old_len = 0, .new_len = 1 };
+	ck_assert_int_eq(TOML2_ERRNO, toml2_reparse(&doc, buf, len, &grow, 1));
+	ck_assert_int_eq(EINVAL, toml2_last_error(&doc).code);
+	ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "b.y")));
+
+	// Errors in a reparsed section are placed within the whole buffer.
+	ck_assert_int_ne(0, check_reparse(&doc, buf, &len, "[b]", "[a]"));
+	ck_assert_int_eq(3, toml2_last_error(&doc).line);
+	toml2_free(&doc);
+}
+END_TEST
+
+// trace_event appends a line describing ev to the buffer ctx.
+static int
+trace_event(void *ctx, const toml2_event_t *ev)
+{
+	char *out = ctx;
+	out += strlen(out);
+	switch (ev->type) {
+	case TOML2_EVENT_TABLE:
+	case TOML2_EVENT_ARRAY_TABLE:
+		out += sprintf(out, TOML2_EVENT_TABLE == ev->type ? "table" : "array table");
+		for (size_t i = 0; i < ev->path_len; i += 1) {
+			out += sprintf(out, " %.*s", (int) ev->path[i].len, ev->path[i].name);
+		}
+		sprintf(out, "\n");
+		break;
+	case TOML2_EVENT_KEY:
+		sprintf(out, "key %.*s\n", (int) ev->key.len, ev->key.name);
+		break;
+	case TOML2_EVENT_VALUE:
+		if (TOML2_STRING == toml2_type(ev->value)) {
+			sprintf(out, "string %.*s\n", (int) toml2_string_len(ev->value), toml2_string(ev->value));
+		}
+		else {
+			sprintf(out, "%s\n", toml2_type_name(toml2_type(ev->value)));
+		}
+		break;
+	case TOML2_EVENT_ARRAY_BEGIN:        sprintf(out, "[\n"); break;
+	case TOML2_EVENT_ARRAY_END:          sprintf(out, "]\n"); break;
+	case TOML2_EVENT_INLINE_TABLE_BEGIN: sprintf(out, "{\n"); break;
+	case TOML2_EVENT_INLINE_TABLE_END:   sprintf(out, "}\n"); break;
+	}
+
+	return 0;
+}
+
+START_TEST(events)
+{
+	const char *str =
+		"a = \"x\\ty\"\n"
+		"[t.\"q\\u0072\"]\n"
+		"b = [1, [2.5], {c = true}]\n"
+		"[[l]]\n"
+		"d = { e = \"f\", g = [] }\n";
+	char trace[512] = "";
+
+	ck_assert_int_eq(0, toml2_parse_events(str, strlen(str), &trace_event, trace));
+	ck_assert_str_eq(
+		"key a\n"
+		"string x\ty\n"
+		"table t qr\n"
+		"key b\n"
+		"[\n"
+		"int\n"
+		"[\n"
+		"float\n"
+		"]\n"
+		"{\n"
+		"key c\n"
+		"bool\n"
+		"}\n"
+		"]\n"
+		"array table l\n"
+		"key d\n"
+		"{\n"
+		"key e\n"
+		"string f\n"
+		"key g\n"
+		"[\n"
+		"]\n"
+		"}\n",
+		trace
+	);
+}
+END_TEST
+
+// stop_event stops the parse at the second event.
+static int
+stop_event(void *ctx, const toml2_event_t *ev)
+{
+	int *count = ctx;
+	*count += 1;
+	return 2 == *count ? -1 : 0;
+}
+
+START_TEST(err_events)
+{
+	char trace[64] = "";
+	const char *str = "a = 1\nb = ";
+	ck_assert_int_ne(0, toml2_parse_events(str, strlen(str), &trace_event, trace));
+	str = "a = tru\n";
+	ck_assert_int_eq(TOML2_MISPLACED_IDENTIFIER, toml2_parse_events(str, strlen(str), &trace_event, trace));
+
+	int count = 0;
+	str = "a = 1\nb = 2\n";
+	ck_assert_int_eq(-1, toml2_parse_events(str, strlen(str), &stop_event, &count));
+	ck_assert_int_eq(2, count);
+}
+END_TEST
+
+START_TEST(paths)
+{
+	const char *str =
+		"title = \"x\"\n"
+		"[database]\n"
+		"host = \"db\"\n"
+		"ports = [1, 2]\n"
+		"[other]\n"
+		"x = \"a\\tb\"\n"
+		"x = 2\n"
+		"[[servers]]\n"
+		"host = \"a\"\n"
+		"port = 1\n"
+		"[[servers]]\n"
+		"host = \"b\"\n"
+		"port = 2\n"
+		"[servers.tls]\n"
+		"on = true\n";
+	const char *want[] = { "database.*", "servers.1.port", "servers.*.tls" };
+
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_paths(&doc, str, strlen(str), 0, want, 3));
+	ck_assert_int_eq(2, toml2_len(&doc));
+	ck_assert_str_eq("db", toml2_string(toml2_get_path(&doc, "database.host")));
+	ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "database.ports.1")));
+	ck_assert_ptr_eq(NULL, toml2_get(&doc, "title"));
+	ck_assert_ptr_eq(NULL, toml2_get(&doc, "other"));
+
+	// Unselected elements stay, so that indexes don't change, but empty.
+	ck_assert_int_eq(2, toml2_len(toml2_get(&doc, "servers")));
+	ck_assert_int_eq(0, toml2_len(toml2_get_path(&doc, "servers.0")));
+	ck_assert_int_eq(2, toml2_len(toml2_get_path(&doc, "servers.1")));
+	ck_assert_int_eq(2, toml2_int(toml2_get_path(&doc, "servers.1.port")));
+	ck_assert_int_eq(true, toml2_bool(toml2_get_path(&doc, "servers.1.tls.on")));
+	ck_assert_ptr_eq(NULL, toml2_get_path(&doc, "servers.1.host"));
+	toml2_free(&doc);
+
+	// Everything outside the paths is still checked for syntax.
+	const char *bad = "[database]\nx = 1\n[other]\nx = [1,\n";
+	toml2_init(&doc);
+	ck_assert_int_ne(0, toml2_parse_paths(&doc, bad, strlen(bad), 0, want, 1));
+	toml2_free(&doc);
+
+	const char *all[] = { "" };
+	toml2_init(&doc);
+	ck_assert_int_ne(0, toml2_parse_paths(&doc, str, strlen(str), 0, all, 1));
+	toml2_free(&doc);
+}
+END_TEST
+
 Suite*
 suite_grammar()
 {
@@ -392,8 +1023,13 @@ suite_grammar()
 		{ "err_dupe_table",        &err_dupe_table        },
 		{ "err_dupe_itable",       &err_dupe_itable       },
 		{ "err_dupe_itable2",      &err_dupe_itable2      },
+		{ "err_first_error",       &err_first_error       },
+		{ "err_position",          &err_position          },
+		{ "parse_tokens",          &parse_tokens          },
+		{ "err_invalid_token",     &err_invalid_token     },
 		{ "sub_empty2",            &sub_empty2            },
 		{ "datetime",              &datetime              },
+		{ "datetime_nsec_offset",  &datetime_nsec_offset  },
 		{ "iarray_trail_comma",    &iarray_trail_comma    },
 		{ "err_iarray_comma",      &err_iarray_comma      },
 		{ "iarray_newlines",       &iarray_newlines       },
@@ -406,6 +1042,18 @@ suite_grammar()
 		{ "numeric_key",           &numeric_key           },
 		{ "numeric_key2",          &numeric_key2          },
 		{ "numeric_key3",          &numeric_key3          },
+		{ "arena",                 &arena                 },
+		{ "exact_size",            &exact_size            },
+		{ "shared_keys",           &shared_keys           },
+		{ "hash_tables",           &hash_tables           },
+		{ "feed",                  &feed                  },
+		{ "err_feed",              &err_feed              },
+		{ "reparse",               &reparse               },
+		{ "reparse_keys",          &reparse_keys          },
+		{ "err_reparse",           &err_reparse           },
+		{ "events",                &events                },
+		{ "err_events",            &err_events            },
+		{ "paths",                 &paths                 },
 	};
 
 	return tcase_build_suite("grammar", tests, sizeof(tests));
@@ -2,6 +2,7 @@
 #include "toml2.h"
 #include "toml2-lexer.h"
 #include <string.h>
+#include <math.h>
 
 static toml2_lex_t
 check_init(const char *str)
@@ -24,7 +25,7 @@ static void
 check_token_err(toml2_lex_t *lexer, toml2_errcode_t err)
 {
 	toml2_token_t tok;
-	ck_assert_int_eq(1, toml2_lex_token(lexer, &tok));
+	ck_assert_int_eq(err, toml2_lex_token(lexer, &tok));
 	ck_assert_int_eq(err, lexer->err.err);
 }
 
@@ -75,6 +76,59 @@ START_TEST(nl_comment)
 }
 END_TEST
 
+START_TEST(nl_run)
+{
+	toml2_lex_t lexer = check_init("x\n \n\t\r\n  y\n");
+	check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+	check_token(&lexer, TOML2_TOKEN_NEWLINE);
+	toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+	size_t line, col;
+	toml2_lex_position(&lexer, tok.start, &line, &col);
+	ck_assert_int_eq(4, line);
+	ck_assert_int_eq(3, col);
+	check_token(&lexer, TOML2_TOKEN_NEWLINE);
+	check_token(&lexer, TOML2_TOKEN_EOF);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
+START_TEST(position)
+{
+	toml2_lex_t lexer = check_init("a = \"\"\"\nxx\n\"\"\" b\n c");
+	size_t line, col;
+
+	check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+	check_token(&lexer, TOML2_TOKEN_EQUALS);
+	check_token(&lexer, TOML2_TOKEN_STRING);
+	toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+	toml2_lex_position(&lexer, tok.start, &line, &col);
+	ck_assert_int_eq(3, line);
+	ck_assert_int_eq(5, col);
+
+	check_token(&lexer, TOML2_TOKEN_NEWLINE);
+	tok = check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+	toml2_lex_position(&lexer, tok.start, &line, &col);
+	ck_assert_int_eq(4, line);
+	ck_assert_int_eq(2, col);
+
+	toml2_lex_position(&lexer, 0, &line, &col);
+	ck_assert_int_eq(1, line);
+	ck_assert_int_eq(1, col);
+	toml2_lex_free(&lexer);
+
+	// Errors get a position without asking.
+	lexer = check_init("x = 1\ny = 1__2");
+	for (int i = 0; i < 6; i += 1) {
+		toml2_token_t tok;
+		ck_assert_int_eq(0, toml2_lex_token(&lexer, &tok));
+	}
+	check_token_err(&lexer, TOML2_INVALID_UNDERSCORE);
+	ck_assert_int_eq(2, lexer.err.line);
+	ck_assert_int_eq(5, lexer.err.col);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
 START_TEST(squote)
 {
 	toml2_lex_t lexer = check_init("'hello'");
@@ -229,6 +283,31 @@ START_TEST(err_dquote_u_eof)
 }
 END_TEST
 
+START_TEST(err_dquote_u_sur)
+{
+	toml2_lex_t lexer = check_init("\"\\uD800\"");
+	check_token_err(&lexer, TOML2_INVALID_ESCAPE);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
+START_TEST(err_utf8)
+{
+	toml2_lex_t lexer;
+	const char *str = "x = 1\ny = '\xC0\x80'";
+	ck_assert_int_eq(TOML2_INVALID_UTF8, toml2_lex_init(&lexer, str, strlen(str)));
+	ck_assert_int_eq(TOML2_INVALID_UTF8, lexer.err.err);
+	ck_assert_int_eq(2, lexer.err.line);
+	ck_assert_int_eq(6, lexer.err.col);
+	toml2_lex_free(&lexer);
+
+	str = "'\xF0\x9F\x90'";
+	ck_assert_int_eq(TOML2_INVALID_UTF8, toml2_lex_init(&lexer, str, strlen(str)));
+	ck_assert_int_eq(TOML2_INVALID_UTF8, lexer.err.err);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
 START_TEST(tdquote)
 {
 	toml2_lex_t lexer = check_init("\"\"\"hello\"\"\"");
@@ -299,6 +378,48 @@ START_TEST(tdquote_bsws)
 }
 END_TEST
 
+START_TEST(tdquote_escq)
+{
+	toml2_lex_t lexer = check_init("\"\"\"a\\\"\"\"b\"\"\"");
+	toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_STRING);
+	ck_assert_str_eq("a\"\"\"b", toml2_token_dbg_utf8(&lexer, &tok));
+	check_token(&lexer, TOML2_TOKEN_EOF);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
+START_TEST(tdquote_long)
+{
+	// Long enough to cross several scan blocks, with escapes and newlines
+	// landing on either side of the block boundaries.
+	char str[512], want[512];
+	size_t w = 0;
+
+	strcpy(str, "\"\"\"");
+	for (size_t i = 0; i < 40; i += 1) {
+		const char *dec = i % 3 ? "0123456789" : "01234\t789";
+
+		strcat(str, i % 3 ? "0123456789" : "01234\\t789");
+		memcpy(want + w, dec, strlen(dec));
+		w += strlen(dec);
+		if (0 == i % 7) {
+			strcat(str, "\n");
+			want[w++] = '\n';
+		}
+	}
+	strcat(str, "\"\"\"");
+	want[w] = 0;
+
+	toml2_lex_t lexer = check_init(str);
+	toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_STRING);
+	char *utf8 = toml2_token_utf8(&lexer, &tok);
+	ck_assert_str_eq(want, utf8);
+	free(utf8);
+	check_token(&lexer, TOML2_TOKEN_EOF);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
 START_TEST(err_tdquote_eof)
 {
 	toml2_lex_t lexer = check_init("\"\"\"foo\"\"");
@@ -426,6 +547,63 @@ START_TEST(ival_space_nl)
 }
 END_TEST
 
+START_TEST(ival_long)
+{
+	const struct {
+		const char *str;
+		int64_t     want;
+	}
+	cases[] = {
+		{ "12345678",              12345678              },
+		{ "1234567890123456",      1234567890123456      },
+		{ "9223372036854775807",   INT64_MAX             },
+		{ "-9223372036854775808",  INT64_MIN             },
+		{ "1_000_000_000_000",     1000000000000         },
+		{ "123456789_123456789",   123456789123456789    },
+		{ "0xDEAD_beef",           0xDEADBEEF            },
+		{ "0x7FFFFFFFFFFFFFFF",    INT64_MAX             },
+		{ "0o755",                 0755                  },
+		{ "0b1101_0110",           0xD6                  },
+		{ "0x0",                   0                     },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+		toml2_lex_t lexer = check_init(cases[i].str);
+		toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_INT);
+		ck_assert(cases[i].want == tok.ival);
+		check_token(&lexer, TOML2_TOKEN_EOF);
+		toml2_lex_free(&lexer);
+	}
+}
+END_TEST
+
+START_TEST(err_ival_range)
+{
+	const struct {
+		const char      *str;
+		toml2_errcode_t  err;
+	}
+	cases[] = {
+		{ "9223372036854775808",  TOML2_INVALID_INT        },
+		{ "-9223372036854775809", TOML2_INVALID_INT        },
+		{ "99999999999999999999", TOML2_INVALID_INT        },
+		{ "0x8000000000000000",   TOML2_INVALID_INT        },
+		{ "0o8",                  TOML2_INVALID_INT        },
+		{ "0b12",                 TOML2_INVALID_INT        },
+		{ "0x",                   TOML2_INVALID_INT        },
+		{ "0x_1",                 TOML2_INVALID_UNDERSCORE },
+		{ "0x1_",                 TOML2_INVALID_UNDERSCORE },
+		{ "12345678__9",          TOML2_INVALID_UNDERSCORE },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+		toml2_lex_t lexer = check_init(cases[i].str);
+		check_token_err(&lexer, cases[i].err);
+		toml2_lex_free(&lexer);
+	}
+}
+END_TEST
+
 START_TEST(err_ival_us)
 {
 	toml2_lex_t lexer = check_init("4__2");
@@ -554,6 +732,43 @@ START_TEST(fval_e4)
 }
 END_TEST
 
+START_TEST(fval_exact)
+{
+	// Each of these must come out bit-identical to the compiler's own
+	// (correctly rounded) reading of the literal.
+	const struct {
+		const char *str;
+		double      want;
+	}
+	cases[] = {
+		{ "10.5",                        10.5                        },
+		{ "-100.5",                      -100.5                      },
+		{ "0.3",                         0.3                         },
+		{ "3.141592653589793",           3.141592653589793           },
+		{ "9007199254740993.0",          9007199254740993.0          },
+		{ "1.7976931348623157e308",      1.7976931348623157e308      },
+		{ "2.2250738585072011e-308",     2.2250738585072011e-308     },
+		{ "4.9e-324",                    4.9e-324                    },
+		{ "1e400",                       HUGE_VAL                    },
+		{ "1e-400",                      0.0                         },
+		{ "1_000.000_001",               1000.000001                 },
+		{ "123456789012345678901234.5",  123456789012345678901234.5  },
+		{ "1.00000000000000011102230246251565404236316680908203125",
+		   1.00000000000000011102230246251565404236316680908203125   },
+		{ "1.00000000000000011102230246251565404236316680908203126",
+		   1.00000000000000011102230246251565404236316680908203126   },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+		toml2_lex_t lexer = check_init(cases[i].str);
+		toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_DOUBLE);
+		ck_assert_int_eq(0, memcmp(&cases[i].want, &tok.fval, sizeof(double)));
+		check_token(&lexer, TOML2_TOKEN_EOF);
+		toml2_lex_free(&lexer);
+	}
+}
+END_TEST
+
 START_TEST(fval_d)
 {
 	toml2_lex_t lexer = check_init("4.2");
@@ -702,7 +917,9 @@ START_TEST(date)
 	ck_assert_int_eq(12, tok.time.tm_hour);
 	ck_assert_int_eq(4, tok.time.tm_min);
 	ck_assert_int_eq(6, tok.time.tm_sec);
-	ck_assert_int_eq(-1 * (8 * 60 * 60 + 12), tok.time.tm_gmtoff);
+	ck_assert_int_eq(-1 * (8 * 60 * 60 + 12 * 60), tok.time.tm_gmtoff);
+	ck_assert_int_eq(-1 * (8 * 60 * 60 + 12 * 60), tok.time_offset);
+	ck_assert_int_eq(0, tok.time_nsec);
 	check_token(&lexer, TOML2_TOKEN_EOF);
 	toml2_lex_free(&lexer);
 }
@@ -719,11 +936,41 @@ START_TEST(date2)
 	ck_assert_int_eq(5, tok.time.tm_min);
 	ck_assert_int_eq(6, tok.time.tm_sec);
 	ck_assert_int_eq(0, tok.time.tm_gmtoff);
+	ck_assert_int_eq(789000000, tok.time_nsec);
 	check_token(&lexer, TOML2_TOKEN_EOF);
 	toml2_lex_free(&lexer);
 }
 END_TEST
 
+START_TEST(date_frac)
+{
+	const struct {
+		const char *str;
+		int32_t     nsec;
+		int32_t     offset;
+	}
+	cases[] = {
+		{ "2001-02-03T04:05:06.1Z",            100000000, 0            },
+		{ "2001-02-03T04:05:06.000000001Z",    1,         0            },
+		{ "2001-02-03T04:05:06.1234567899Z",   123456789, 0            },
+		{ "2001-02-03T04:05:06.5+05:30",       500000000, 19800        },
+		{ "2001-02-03T04:05:06-00:01",         0,         -60          },
+		{ "2001-02-03t04:05:06.25z",           250000000, 0            },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+		toml2_lex_t lexer = check_init(cases[i].str);
+		toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_DATE);
+		ck_assert_int_eq(2001, tok.time.tm_year);
+		ck_assert_int_eq(6, tok.time.tm_sec);
+		ck_assert_int_eq(cases[i].nsec, tok.time_nsec);
+		ck_assert_int_eq(cases[i].offset, tok.time_offset);
+		check_token(&lexer, TOML2_TOKEN_EOF);
+		toml2_lex_free(&lexer);
+	}
+}
+END_TEST
+
 START_TEST(date_short)
 {
 	toml2_lex_t lexer = check_init("2001-02-03");
@@ -769,7 +1016,7 @@ START_TEST(err_date_short)
 		toml2_lex_t lexer = check_init(tests[i]);
 		toml2_token_t tok;
 
-		if (1 != toml2_lex_token(&lexer, &tok)) {
+		if (0 == toml2_lex_token(&lexer, &tok)) {
 			ck_assert_msg("Assertion: '%s' should fail to lex", tests[i]);
 		}
 		if (TOML2_INVALID_DATE != lexer.err.err) {
@@ -795,6 +1042,24 @@ START_TEST(id)
 }
 END_TEST
 
+START_TEST(id_ends)
+{
+	// Identifiers run up to whitespace or punctuation, and take any other
+	// byte (including quotes and non-ASCII) along with them.
+	const char *ends = " \t\r\n.,=[]{}:#";
+
+	for (size_t i = 0; i < strlen(ends); i += 1) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "h\xC3\xA9l'\"o%c", ends[i]);
+
+		toml2_lex_t lexer = check_init(buf);
+		toml2_token_t tok = check_token(&lexer, TOML2_TOKEN_IDENTIFIER);
+		ck_assert_str_eq("h\xC3\xA9l'\"o", toml2_token_dbg_utf8(&lexer, &tok));
+		toml2_lex_free(&lexer);
+	}
+}
+END_TEST
+
 START_TEST(table_decl)
 {
 	toml2_lex_t lexer = check_init("[  foo \t .\"ba\\\"\"  ]\n");
@@ -895,6 +1160,62 @@ START_TEST(err_lead_0_i_neg)
 }
 END_TEST
 
+START_TEST(lex_all)
+{
+	const char *str = "a = [1, 2.5, 1979-05-27T07:32:00Z] # c\nb = \"\\t\"\n";
+	toml2_lex_t pull = check_init(str);
+	toml2_lex_t lexer = check_init(str);
+	toml2_tokens_t toks = {0};
+
+	ck_assert_int_eq(0, toml2_lex_all(&lexer, &toks));
+	ck_assert_int_eq(16, toks.len);
+	ck_assert_int_eq(2, toks.nums_len);
+	ck_assert_int_eq(1, toks.dates_len);
+
+	// Everything the grammar uses matches the pull lexer.
+	for (size_t i = 0; i < toks.len; i += 1) {
+		toml2_token_t want = check_token(&pull, toks.toks[i].type);
+		toml2_token_t tok;
+		toml2_tokens_get(&toks, i, &tok);
+
+		ck_assert_int_eq(want.start, tok.start);
+		ck_assert_int_eq(want.end, tok.end);
+		ck_assert_int_eq(want.escaped, tok.escaped);
+
+		if (TOML2_TOKEN_INT == tok.type) {
+			ck_assert_int_eq(want.ival, tok.ival);
+		}
+		else if (TOML2_TOKEN_DOUBLE == tok.type) {
+			ck_assert_double_eq(want.fval, tok.fval);
+		}
+		else if (TOML2_TOKEN_DATE == tok.type) {
+			ck_assert_int_eq(want.time.tm_year, tok.time.tm_year);
+			ck_assert_int_eq(want.time.tm_mon, tok.time.tm_mon);
+			ck_assert_int_eq(want.time.tm_min, tok.time.tm_min);
+			ck_assert_int_eq(want.time_offset, tok.time_offset);
+		}
+	}
+	ck_assert_int_eq(TOML2_TOKEN_EOF, toks.toks[toks.len - 1].type);
+
+	toml2_tokens_free(&toks);
+	toml2_lex_free(&lexer);
+	toml2_lex_free(&pull);
+}
+END_TEST
+
+START_TEST(err_lex_all)
+{
+	toml2_lex_t lexer = check_init("a = 1\nb = \"open\n");
+	toml2_tokens_t toks = {0};
+
+	ck_assert_int_eq(TOML2_UNCLOSED_DQUOTE, toml2_lex_all(&lexer, &toks));
+	ck_assert_int_eq(TOML2_UNCLOSED_DQUOTE, lexer.err.err);
+
+	toml2_tokens_free(&toks);
+	toml2_lex_free(&lexer);
+}
+END_TEST
+
 Suite*
 suite_lexer()
 {
@@ -904,6 +1225,8 @@ suite_lexer()
 		{ "comment_nest",     &comment_nest     },
 		{ "comment_nl",       &comment_nl       },
 		{ "nl_comment",       &nl_comment       },
+		{ "nl_run",           &nl_run           },
+		{ "position",         &position         },
 		{ "squote",           &squote           },
 		{ "squote_bs",        &squote_bs        },
 		{ "squote_bs2",       &squote_bs2       },
@@ -919,6 +1242,8 @@ suite_lexer()
 		{ "dquote_comment",   &dquote_comment   },
 		{ "err_dquote_u_bad", &err_dquote_u_bad },
 		{ "err_dquote_u_eof", &err_dquote_u_eof },
+		{ "err_dquote_u_sur", &err_dquote_u_sur },
+		{ "err_utf8",         &err_utf8         },
 		{ "tdquote",          &tdquote          },
 		{ "tdquote_nl",       &tdquote_nl       },
 		{ "tdquote_bsnl",     &tdquote_bsnl     },
@@ -926,6 +1251,8 @@ suite_lexer()
 		{ "tdquote_bs",       &tdquote_bs       },
 		{ "tdquote_ws",       &tdquote_ws       },
 		{ "tdquote_bsws",     &tdquote_bsws     },
+		{ "tdquote_escq",     &tdquote_escq     },
+		{ "tdquote_long",     &tdquote_long     },
 		{ "err_tdquote_eof",  &err_tdquote_eof  },
 		{ "tsquote",          &tsquote          },
 		{ "tsquote_nl",       &tsquote_nl       },
@@ -939,6 +1266,8 @@ suite_lexer()
 		{ "ival_us",          &ival_us          },
 		{ "ival_zero",        &ival_zero        },
 		{ "ival_space_nl",    &ival_space_nl    },
+		{ "ival_long",        &ival_long        },
+		{ "err_ival_range",   &err_ival_range   },
 		{ "err_ival_us",      &err_ival_us      },
 		{ "err_ival_last_us", &err_ival_last_us },
 		{ "err_ival_neg2",    &err_ival_neg2    },
@@ -952,6 +1281,7 @@ suite_lexer()
 		{ "fval_e2",          &fval_e2          },
 		{ "fval_e3",          &fval_e3          },
 		{ "fval_e4",          &fval_e4          },
+		{ "fval_exact",       &fval_exact       },
 		{ "fval_d",           &fval_d           },
 		{ "fval_d2",          &fval_d2          },
 		{ "fval_de",          &fval_de          },
@@ -970,10 +1300,14 @@ suite_lexer()
 		{ "err_fval_trail",   &err_fval_trail   },
 		{ "date",             &date             },
 		{ "date2",            &date2            },
+		{ "date_frac",        &date_frac        },
 		{ "date_short",       &date_short       },
 		{ "err_date_short",   &err_date_short   },
 		{ "id",               &id               },
+		{ "id_ends",          &id_ends          },
 		{ "table_decl",       &table_decl       },
+		{ "lex_all",          &lex_all          },
+		{ "err_lex_all",      &err_lex_all      },
 		{ "id_octopus",       &id_octopus       },
 		{ "err_id_comment",   &err_id_comment   },
 		{ "basic_table",      &basic_table      },
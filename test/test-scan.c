@@ -0,0 +1,253 @@
+#include "util.h"
+#include "toml2-scan.h"
+#include "toml2-index.h"
+
+// The kernels have separate block and tail paths, so every check here is
+// repeated at each length/position up to a few blocks to cover both.
+#define SCAN_MAX 100
+
+START_TEST(blank)
+{
+	char buf[SCAN_MAX];
+
+	for (size_t len = 0; len < SCAN_MAX; len += 1) {
+		for (size_t stop = 0; stop <= len; stop += 1) {
+			for (size_t i = 0; i < len; i += 1) {
+				buf[i] = " \t\r"[i % 3];
+			}
+			if (stop < len) {
+				buf[stop] = 'x';
+			}
+
+			ck_assert_int_eq(stop, toml2_scan_blank(buf, len));
+		}
+	}
+}
+END_TEST
+
+START_TEST(blank_newline)
+{
+	const char *str = "    \n    ";
+	ck_assert_int_eq(4, toml2_scan_blank(str, strlen(str)));
+}
+END_TEST
+
+START_TEST(space)
+{
+	char buf[SCAN_MAX];
+
+	for (size_t len = 0; len < SCAN_MAX; len += 1) {
+		for (size_t stop = 0; stop <= len; stop += 1) {
+			for (size_t i = 0; i < len; i += 1) {
+				buf[i] = 0 == i % 7 ? '\n' : ' ';
+			}
+			if (stop < len) {
+				buf[stop] = 'x';
+			}
+
+			ck_assert_int_eq(stop, toml2_scan_space(buf, len));
+		}
+	}
+}
+END_TEST
+
+START_TEST(newline)
+{
+	char buf[SCAN_MAX];
+
+	for (size_t len = 0; len < SCAN_MAX; len += 1) {
+		for (size_t stop = 0; stop <= len; stop += 1) {
+			memset(buf, '#', len);
+			if (stop < len) {
+				buf[stop] = '\n';
+			}
+
+			ck_assert_int_eq(stop, toml2_scan_newline(buf, len));
+		}
+	}
+}
+END_TEST
+
+START_TEST(string)
+{
+	char buf[SCAN_MAX];
+	const char stops[] = { '"', '\\', '\n', 0 };
+
+	for (size_t len = 0; len < SCAN_MAX; len += 1) {
+		for (size_t stop = 0; stop <= len; stop += 1) {
+			for (size_t i = 0; i < sizeof(stops); i += 1) {
+				memset(buf, '\'', len);
+				if (stop < len) {
+					buf[stop] = stops[i];
+				}
+
+				ck_assert_int_eq(stop, toml2_scan_string(buf, len, '"', '\\'));
+			}
+		}
+	}
+}
+END_TEST
+
+START_TEST(utf8)
+{
+	char buf[SCAN_MAX];
+	// Valid sequences of each length, written at every offset so that they
+	// straddle block boundaries.
+	const char *good[] = { "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80" };
+
+	for (size_t len = 0; len < SCAN_MAX; len += 1) {
+		for (size_t i = 0; i < 3; i += 1) {
+			size_t seq = strlen(good[i]);
+			for (size_t at = 0; at + seq <= len; at += 1) {
+				memset(buf, 'a', len);
+				memcpy(buf + at, good[i], seq);
+				ck_assert_int_eq(len, toml2_scan_utf8(buf, len));
+			}
+		}
+	}
+}
+END_TEST
+
+START_TEST(utf8_bad)
+{
+	char buf[SCAN_MAX];
+	// Each of these is invalid at its first byte.
+	const char *bad[] = {
+		"\x80",                 // stray continuation
+		"\xC0\xAF",             // overlong
+		"\xE0\x80\xAF",         // overlong
+		"\xF0\x80\x80\xAF",     // overlong
+		"\xED\xA0\x80",         // surrogate
+		"\xF4\x90\x80\x80",     // past U+10FFFF
+		"\xF8\x88\x80\x80\x80", // five bytes
+		"\xFF",
+		"\xC3" "a",             // too short
+		"\xE2\x82" "a",
+		"\xF0\x9F\x98" "a",
+	};
+
+	for (size_t len = 1; len < SCAN_MAX; len += 1) {
+		for (size_t i = 0; i < sizeof(bad) / sizeof(*bad); i += 1) {
+			size_t seq = strlen(bad[i]);
+			for (size_t at = 0; at + seq <= len; at += 1) {
+				// Lead with a valid multibyte character where there's
+				// room, so the bad one directly follows a good one.
+				memset(buf, 'a', len);
+				if (at >= 2) {
+					memcpy(buf + at - 2, "\xC3\xA9", 2);
+				}
+				memcpy(buf + at, bad[i], seq);
+				ck_assert_int_eq(at, toml2_scan_utf8(buf, len));
+			}
+		}
+	}
+}
+END_TEST
+
+START_TEST(utf8_truncated)
+{
+	char buf[SCAN_MAX];
+	const char *seq = "\xF0\x9F\x98\x80";
+
+	for (size_t len = 1; len < SCAN_MAX; len += 1) {
+		for (size_t cut = 1; cut < 4 && cut <= len; cut += 1) {
+			memset(buf, 'a', len);
+			memcpy(buf + len - cut, seq, cut);
+			ck_assert_int_eq(len - cut, toml2_scan_utf8(buf, len));
+		}
+	}
+}
+END_TEST
+
+START_TEST(marks)
+{
+	char buf[64];
+	memset(buf, 'x', sizeof(buf));
+	buf[0] = '[';
+	buf[31] = '"';
+	buf[32] = '\n';
+	buf[40] = '\\';
+	buf[63] = 0;
+
+	toml2_scan_marks_t m;
+	toml2_scan_marks(buf, &m);
+	ck_assert(m.punct == 1);
+	ck_assert(m.dquote == (uint64_t) 1 << 31);
+	ck_assert(m.newline == (uint64_t) 1 << 32);
+	ck_assert(m.backslash == (uint64_t) 1 << 40);
+	ck_assert(m.nul == (uint64_t) 1 << 63);
+	ck_assert(0 == m.squote && 0 == m.hash);
+}
+END_TEST
+
+// check_index compares the index of str against the want_len offsets in
+// want, where a negative offset is a clean string's opening quote.
+static void
+check_index(const char *str, const int *want, size_t want_len)
+{
+	toml2_index_t idx;
+	ck_assert_int_eq(0, toml2_index_build(&idx, str, strlen(str)));
+	ck_assert_int_eq(want_len, idx.len);
+
+	for (size_t i = 0; i < want_len; i += 1) {
+		ck_assert_int_eq(abs(want[i]), idx.pos[i]);
+		ck_assert_int_eq(want[i] < 0, toml2_index_clean(&idx, i));
+	}
+
+	toml2_index_free(&idx);
+}
+
+START_TEST(structural)
+{
+	const int simple[] = { 2, -4, 8, 9 };
+	check_index("a = \"[#]\"\n", simple, 4);
+
+	// Neither comments nor escaped or multi-line strings have their
+	// insides indexed, or an entry for the end of the string.
+	const int skipped[] = { 0, 5, 6, 8, 9, 11, 12, 16, 18, 19, 31 };
+	check_index("# [x]\n[t]\na=\"\\\"\"\nb='''\n'[x]\n'''\n", skipped, 11);
+
+	// Nor do empty strings, whose second quote isn't an opener.
+	const int empty[] = { 2, 4, 6, -8, 10 };
+	check_index("a = \"\", 'x'", empty, 5);
+}
+END_TEST
+
+START_TEST(structural_blocks)
+{
+	// Strings and comments running across block boundaries.
+	char buf[300];
+	memset(buf, ' ', sizeof(buf));
+	buf[sizeof(buf) - 1] = 0;
+
+	buf[10] = '"';
+	buf[100] = '"';
+	buf[101] = '#';
+	buf[150] = '[';
+	buf[200] = '\n';
+	buf[201] = ',';
+
+	const int want[] = { -10, 100, 101, 200, 201 };
+	check_index(buf, want, 5);
+}
+END_TEST
+
+Suite*
+suite_scan()
+{
+	tcase_t tests[] = {
+		{ "blank",             &blank             },
+		{ "blank_newline",     &blank_newline     },
+		{ "space",             &space             },
+		{ "newline",           &newline           },
+		{ "string",            &string            },
+		{ "utf8",              &utf8              },
+		{ "utf8_bad",          &utf8_bad          },
+		{ "utf8_truncated",    &utf8_truncated    },
+		{ "marks",             &marks             },
+		{ "structural",        &structural        },
+		{ "structural_blocks", &structural_blocks },
+	};
+
+	return tcase_build_suite("scan", tests, sizeof(tests));
+}
@@ -24,3 +24,12 @@ tcase_build_suite(const char *name, tcase_t *tests, size_t blen)
 	return tcase_build_suite_with_fixtures(name, NULL, NULL, tests, blen);
 }
 
+
+toml2_t
+check_init_flags(const char *str, size_t len, int flags)
+{
+	toml2_t doc;
+	toml2_init(&doc);
+	ck_assert_int_eq(0, toml2_parse_flags(&doc, str, len, flags));
+	return doc;
+}
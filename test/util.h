@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <check.h>
+#include "toml2.h"
 
 typedef struct {
 	const char *name;
@@ -17,6 +18,10 @@ tcase_t;
 
 Suite* tcase_build_suite(const char *name, tcase_t *tests, size_t blen);
 
+// check_init_flags parses the len bytes at str with flags into a new
+// document, failing the test if that doesn't work.
+toml2_t check_init_flags(const char *str, size_t len, int flags);
+
 #ifndef ck_assert_double_eq
 #define _ck_assert_double(X, OP, Y) do { \
 	double _ck_x = (X); \